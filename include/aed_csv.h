@@ -40,14 +40,29 @@ typedef char FILNAME[80];
 
 #define bufsize 2048
 
+/* temporal aggregation modes for set_csv_output_agg */
+#define CSV_AGG_NONE  0
+#define CSV_AGG_NTH   1
+#define CSV_AGG_MEAN  2
+#define CSV_AGG_MIN   3
+#define CSV_AGG_MAX   4
+#define CSV_AGG_SUM   5
+
 #ifdef __STDC__
 
+#include <stddef.h>
+#include "aed_time.h"
+
 /*############################################################################*/
 
+  typedef void (*csv_row_func)(void *user, const char *time, int n, const AED_REAL *vals);
+
   int open_csv_input_(const char *fname, int *len, const char *timefmt, int *l2);
   int find_csv_var_(int *csv, const char *name, int *len);
 
   int open_csv_input(const char *fname, const char *timefmt);
+  int open_csv_input_mem(char *buf, size_t len, const char *timefmt);
+  int open_csv_input_fd(int fd, const char *timefmt);
   int count_lines(const char *fname);
   int find_csv_var(int csv, const char *name);
 
@@ -55,13 +70,20 @@ typedef char FILNAME[80];
   int get_csv_type(int csv, int idx);
   int get_csv_val_i(int csv, int idx);
   AED_REAL get_csv_val_r(int csv, int idx);
+  int get_csv_row_r(int csv, int n, const int *idx, AED_REAL *out);
+  int get_csv_row_r_(int *csv, int *n, const int *idx, AED_REAL *out);
   int get_csv_val_s(int csv, int idx, char *s);
   const char *get_csv_colname(int csv, int idx);
 
   int close_csv_input(int csvf);
 
   int open_csv_output(const char *out_dir, const char *fname);
+  int open_csv_output_mem(char **buf, size_t *len);
+  int open_csv_output_cb(csv_row_func cb, void *user);
+  int open_csv_output_shm(const char *name, int n_slots, int slot_size);
   int close_csv_output(int outf);
+  const char *get_csv_out_colname(int f, int idx);
+  int set_csv_output_agg(int f, int mode, int period);
 
   void csv_header_start(int f);
   void csv_header_var(int f, const char *v);
@@ -73,8 +95,27 @@ typedef char FILNAME[80];
   void write_csv_end(int f);
   void write_csv_var(int f, const char *name, AED_REAL val, const char *cval, int last);
 
+  aed_time_t get_csv_time(int csv);
+  int set_csv_calendar(int csv, int cal);
+  int set_csv_calendar_(int *csv, int *cal);
+  int find_csv_time(int csv, aed_time_t t);
   void find_day(int csv, int time_idx, int jday);
 
+  int open_csv_matrix(const char *out_dir, const char *fname,
+                                         const char *var, int n, int binary);
+  int write_csv_matrix(int m, aed_time_t t, const AED_REAL *vals);
+  int close_csv_matrix(int m);
+  int open_csv_matrix_(const char *out_dir, int *l1, const char *fname, int *l2,
+                       const char *var, int *l3, int *n, int *binary);
+  int write_csv_matrix_(int *m, int *jul, int *secs, const AED_REAL *vals);
+  int close_csv_matrix_(int *m);
+
+  int open_csv_shm_reader(const char *name);
+  int read_csv_shm_header(int r, char *line, int maxlen);
+  int read_csv_shm(int r, char *line, int maxlen);
+  int read_csv_shm_cut(int r);
+  void close_csv_shm_reader(int r);
+
 #else
 
   INTERFACE
@@ -99,6 +140,11 @@ typedef char FILNAME[80];
         CINTEGER,INTENT(in) :: csv
      END FUNCTION load_csv_line
 
+     CINTEGER FUNCTION set_csv_calendar(csv, cal) BIND(C, name="set_csv_calendar_")
+        USE ISO_C_BINDING
+        CINTEGER,INTENT(in) :: csv, cal
+     END FUNCTION set_csv_calendar
+
      CINTEGER FUNCTION get_csv_type(csv, idx)
         USE ISO_C_BINDING
         CINTEGER,INTENT(in) :: csv, idx
@@ -114,12 +160,36 @@ typedef char FILNAME[80];
         CINTEGER,INTENT(in) :: csv, idx
      END FUNCTION get_csv_val_r
 
+     CINTEGER FUNCTION get_csv_row_r(csv, n, idx, out) BIND(C, name="get_csv_row_r_")
+        USE ISO_C_BINDING
+        CINTEGER,INTENT(in)  :: csv, n
+        CINTEGER,INTENT(in)  :: idx(*)
+        AED_REAL,INTENT(out) :: out(*)
+     END FUNCTION get_csv_row_r
+
      CINTEGER FUNCTION get_csv_val_s(csv, idx, s)
         USE ISO_C_BINDING
         CINTEGER,INTENT(in) :: csv, idx
         CCHARACTER,INTENT(out) :: s
      END FUNCTION get_csv_val_s
 
+     CINTEGER FUNCTION open_csv_matrix(out_dir,l1,fname,l2,var,l3,n,binary) BIND(C, name="open_csv_matrix_")
+        USE ISO_C_BINDING
+        CCHARACTER,INTENT(in) :: out_dir(*), fname(*), var(*)
+        CINTEGER,INTENT(in)   :: l1, l2, l3, n, binary
+     END FUNCTION open_csv_matrix
+
+     CINTEGER FUNCTION write_csv_matrix(m, jul, secs, vals) BIND(C, name="write_csv_matrix_")
+        USE ISO_C_BINDING
+        CINTEGER,INTENT(in) :: m, jul, secs
+        AED_REAL,INTENT(in) :: vals(*)
+     END FUNCTION write_csv_matrix
+
+     CINTEGER FUNCTION close_csv_matrix(m) BIND(C, name="close_csv_matrix_")
+        USE ISO_C_BINDING
+        CINTEGER,INTENT(in) :: m
+     END FUNCTION close_csv_matrix
+
     !----------------------------------------------------
 
   END INTERFACE
@@ -32,9 +32,23 @@
 
 #include "libutil.h"
 
+#define CAL_GREGORIAN   0
+#define CAL_NOLEAP      1
+#define CAL_ALL_LEAP    2
+#define CAL_360DAY      3
+#define N_CALENDARS     4
+
 #ifdef __STDC__
 
   /******************************************************************************/
+  #define MAX_TIME_OPS  40
+
+  typedef struct timeop {
+      char op;                  /* literal, blank or kind of field            */
+      char width;               /* digits, 0 for as many as are there         */
+      char c;                   /* the literal, or the pad for a field        */
+  } timeop;
+
   typedef struct timefmt {
       int Ypos, Ydig;
       int Mpos, Mdig;
@@ -43,8 +57,28 @@
       int mpos, mdig;
       int spos, sdig;
       char *fmt;
+      int   nops;
+      timeop ops[MAX_TIME_OPS];
+      int   cal;                /* CAL_GREGORIAN unless set after decoding    */
   } timefmt;
 
+  /******************************************************************************/
+  typedef struct timecache {
+      timefmt *tf;              /* NULL for the write_time_string layout      */
+      int   valid;
+      int   jul, secs;          /* the time last rendered into str            */
+      int   hh, mi, ss;
+      int   hoff, hwid;         /* character offset and width of each         */
+      int   moff, mwid;         /*  time of day field, offset -1 if it        */
+      int   soff, swid;         /*  cannot be patched in place                */
+      char  pad;
+      int   len;                /* length of a rendered string, -1 if varies  */
+      char  str[64];
+  } timecache;
+
+  /* a time as seconds since the start of true Julian day 0 */
+  typedef long long aed_time_t;
+
   void calendar_date(int julian, int *yyyy, int *mm, int *dd);
   int julian_day(int y, int m, int d);
   void read_time_string(const char *timestr, int *jul, int *secs);
@@ -52,10 +86,38 @@
   int time_diff(int jul1, int secs1, int jul2, int secs2);
   int day_of_year(int jday);
 
+  aed_time_t time_from_jul(int jul, int secs);
+  void time_to_jul(aed_time_t t, int *jul, int *secs);
+  aed_time_t time_diff_secs(aed_time_t t1, aed_time_t t2);
+  aed_time_t read_time_secs(const char *timestr, timefmt *tf);
+  void write_time_secs(char *timestr, timefmt *tf, aed_time_t t);
+
+  /* an f... (fraction of a second) field is accepted but ignored */
   timefmt *decode_time_format(const char *fmt);
+  void free_time_format(timefmt *tf);
+  int check_time_formatted(const char *timestr, timefmt *tf);
+  timefmt *guess_time_format(int n, const char **samples);
   void read_time_formatted(const char *timestr, timefmt *tf, int *jul, int *secs);
   void write_time_formatted(char *timestr, timefmt *tf, int jul, int secs);
 
+  void calendar_date_v(int n, const int *julian, int *yyyy, int *mm, int *dd);
+  void julian_day_v(int n, const int *y, const int *m, const int *d, int *julian);
+  void day_of_year_v(int n, const int *jday, int *doy);
+  void calendar_date_v_(int *n, const int *julian, int *yyyy, int *mm, int *dd);
+  void julian_day_v_(int *n, const int *y, const int *m, const int *d, int *julian);
+  void day_of_year_v_(int *n, const int *jday, int *doy);
+
+  int julian_day_cal(int cal, int y, int m, int d);
+  void calendar_date_cal(int cal, int julian, int *yyyy, int *mm, int *dd);
+  int day_of_year_cal(int cal, int jday);
+  int calendar_from_name(const char *name);
+  void calendar_date_cal_(int *cal, int *julian, int *yyyy, int *mm, int *dd);
+  int julian_day_cal_(int *cal, int *y, int *m, int *d);
+  int day_of_year_cal_(int *cal, int *jday);
+
+  void init_time_cache(timecache *tc, timefmt *tf);
+  void write_time_cached(char *timestr, timecache *tc, int jul, int secs);
+
 #else
 
   INTERFACE
@@ -93,6 +155,43 @@
         CINTEGER,INTENT(in) :: jday
      END FUNCTION day_of_year
 
+     SUBROUTINE calendar_date_v(n,julian,yyyy,mm,dd) BIND(C, name="calendar_date_v_")
+        USE ISO_C_BINDING
+        CINTEGER,INTENT(in)  :: n
+        CINTEGER,INTENT(in)  :: julian(*)
+        CINTEGER,INTENT(out) :: yyyy(*),mm(*),dd(*)
+     END SUBROUTINE calendar_date_v
+
+     SUBROUTINE julian_day_v(n,yyyy,mm,dd,julian) BIND(C, name="julian_day_v_")
+        USE ISO_C_BINDING
+        CINTEGER,INTENT(in)  :: n
+        CINTEGER,INTENT(in)  :: yyyy(*),mm(*),dd(*)
+        CINTEGER,INTENT(out) :: julian(*)
+     END SUBROUTINE julian_day_v
+
+     SUBROUTINE day_of_year_v(n,jday,doy) BIND(C, name="day_of_year_v_")
+        USE ISO_C_BINDING
+        CINTEGER,INTENT(in)  :: n
+        CINTEGER,INTENT(in)  :: jday(*)
+        CINTEGER,INTENT(out) :: doy(*)
+     END SUBROUTINE day_of_year_v
+
+     SUBROUTINE calendar_date_cal(cal,julian,yyyy,mm,dd) BIND(C, name="calendar_date_cal_")
+        USE ISO_C_BINDING
+        CINTEGER,INTENT(in)  :: cal,julian
+        CINTEGER,INTENT(out) :: yyyy,mm,dd
+     END SUBROUTINE calendar_date_cal
+
+     CINTEGER FUNCTION julian_day_cal(cal,yyyy,mm,dd) BIND(C, name="julian_day_cal_")
+        USE ISO_C_BINDING
+        CINTEGER,INTENT(in) :: cal,yyyy,mm,dd
+     END FUNCTION julian_day_cal
+
+     CINTEGER FUNCTION day_of_year_cal(cal,jday) BIND(C, name="day_of_year_cal_")
+        USE ISO_C_BINDING
+        CINTEGER,INTENT(in) :: cal,jday
+     END FUNCTION day_of_year_cal
+
  END INTERFACE
 
 !+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
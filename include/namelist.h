@@ -55,7 +55,20 @@ typedef struct _namelist_ {
 
 int open_namelist(const char *fname);
 int get_namelist(int file, NAMELIST *nl);
+int get_namelist_typed(int file, NAMELIST *nl);
 int get_nml_listlen(int file, const char *section, const char *entry);
+const void *get_nml_view(int file, const char *section, const char *entry,
+                                                           int type, int *len);
+int open_namelist_overlay(int base);
+int set_namelist_entry(int file, const char *section, const char *entry,
+                                                            const char *text);
+int save_namelist_snapshot(int file, const char *snapname);
+int namelist_changed(int file);
+int namelist_depends_on(int file, const char *fname);
+void clear_namelist_cache(void);
+int watch_namelist(int file, int interval);
+int poll_namelist(int file);
+int nml_section_changed(int file, const char *section, int since);
 void close_namelist(int file);
 
 #endif
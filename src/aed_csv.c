@@ -26,12 +26,19 @@
  *                                                                            *
  ******************************************************************************/
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
 #ifndef _WIN32
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#else
+#define fdopen _fdopen
 #endif
 
 #include "libutil.h"
@@ -41,22 +48,90 @@
 
 /*----------------------------------------------------------------------------*/
 
+#define OUT_CLOSED    0
+#define OUT_FILE      1
+#define OUT_MEM       2
+#define OUT_CALLBACK  3
+#define OUT_SHM       4
+
+/******************************************************************************
+ * Layout of the shared memory ring used by open_csv_output_shm.  There is a  *
+ * single writer; each slot carries a sequence number that is odd while the   *
+ * slot is being written, so readers can copy a row without any locking and   *
+ * then check that it was not overwritten under them.  A row or header line   *
+ * too long for its space is cut short and flagged as such.                   *
+ ******************************************************************************/
+#define SHM_MAGIC     "AEDCSVR1"
+
+typedef struct _CSV_SHM_HDR {
+    char     magic[8];
+    uint32_t n_slots;
+    uint32_t slot_size;      /* bytes of text a slot can hold */
+    uint32_t hdr_size;       /* bytes reserved for the header line */
+    uint32_t hdr_cut;        /* nonzero if the header line was cut short */
+    uint64_t hdr_seq;        /* odd while the header line is being written */
+    uint64_t seq;            /* number of rows published so far */
+} CSV_SHM_HDR;
+
+typedef struct _CSV_SHM_SLOT {
+    uint64_t seq;            /* 2*row+1 while writing, 2*row+2 when done */
+    uint32_t len;
+    uint32_t cut;            /* nonzero if the row was cut short */
+} CSV_SHM_SLOT;
+
+#define SHM_SLOT_BYTES(sz)   (sizeof(CSV_SHM_SLOT) + (((sz) + 7) & ~7))
+#define SHM_TOTAL(n, sz, h)  (sizeof(CSV_SHM_HDR) + (((h) + 7) & ~7) + (size_t)(n) * SHM_SLOT_BYTES(sz))
+
 typedef struct _AED_CSV_OUT {
+    int      kind;
     FILE    *f;
+    char   **mem;         /* OUT_MEM : the caller's buffer and its length */
+    size_t  *mem_len;
+    size_t   mem_cap;
+    csv_row_func cb;      /* OUT_CALLBACK */
+    void    *cb_data;
+    CSV_SHM_HDR *shm;     /* OUT_SHM : the mapped ring, its size and name */
+    size_t   shm_size;
+    char    *shm_name;
+    char    *line;        /* OUT_SHM : the row being assembled */
+    size_t   line_len;
+    int      line_cut;    /* OUT_SHM : the row being assembled overflowed */
+    int      cut_warned;
+    int      in_header;
+    int      n_vals;
     char     time[20];
     int      n_cols;
     char   **header;
     AED_REAL buff[MAX_OUT_VALUES+4];
+
+    /* temporal aggregation state, see set_csv_output_agg */
+    int       agg;
+    int       agg_period;
+    int       agg_count;
+    aed_time_t agg_key;
+    AED_REAL  agg_val[MAX_OUT_VALUES+4];
+    int       agg_n[MAX_OUT_VALUES+4];
+    timecache agg_tc;
 } AED_CSV_OUT;
 
 static int _n_outf = 0;
 static AED_CSV_OUT csv_of[MAX_OUT_FILES];
 
+static void _flush_agg(int f);
+
 typedef struct _AED_CSV_IN {
     FILE  *f;
+    char  *mem;           /* caller's buffer when reading from memory */
+    size_t mem_len;
+    size_t mem_pos;
+    char **pending;       /* lines read ahead at open, to be handed out first */
+    int    n_pending;
+    int    next_pending;
     int    n_cols;
     char **header;
     AED_REAL *curLine;
+    aed_time_t curTime;   /* exact time of the current line */
+    char   curTimeStr[64];/* and as it was in the file */
     timefmt  *tf;
 } AED_CSV_IN;
 
@@ -106,11 +181,60 @@ static char *read_line(FILE *inf)
 
     if ( !strlen(ln) && feof(inf) ) {
         free(ln);
-        ln = NULL;
+        _ln = ln = NULL;
+    }
+
+    return ln;
+}
+/*----------------------------------------------------------------------------*/
+static char *read_mem_line(AED_CSV_IN *in)
+{
+    char *ln, *e, *end;
+    size_t len;
+
+    if ( in->mem_pos >= in->mem_len ) return NULL;
+
+    ln = in->mem + in->mem_pos;
+    end = in->mem + in->mem_len;
+    if ( (e = memchr(ln, '\n', end - ln)) != NULL ) {
+        /* terminate in place, the caller's buffer is our line buffer */
+        in->mem_pos = (e - in->mem) + 1;
+        *e = 0;
+    } else {
+        /* an unterminated last line - the only one we have to copy */
+        len = end - ln;
+        if ( (e = realloc(_ln, len+1)) == NULL ) return NULL;
+        _ln = e;
+        memcpy(_ln, ln, len);
+        _ln[len] = 0;
+        ln = _ln;
+        e = ln + len;
+        in->mem_pos = in->mem_len;
     }
 
+    while ( e > ln && (e[-1] == '\r' || e[-1] == '\n') ) *--e = 0;
+
+    if ( *ln == 0 && in->mem_pos >= in->mem_len ) return NULL;
+
     return ln;
 }
+/*----------------------------------------------------------------------------*/
+static char *source_line(AED_CSV_IN *in)
+{
+    if ( in->f != NULL ) return read_line(in->f);
+    if ( in->mem != NULL ) return read_mem_line(in);
+    return NULL;
+}
+/*----------------------------------------------------------------------------*/
+static char *next_line(AED_CSV_IN *in)
+{
+    if ( in->next_pending < in->n_pending ) {
+        /* the last one handed out is finished with by now */
+        if ( in->next_pending > 0 ) free(in->pending[in->next_pending-1]);
+        return in->pending[in->next_pending++];
+    }
+    return source_line(in);
+}
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
@@ -153,6 +277,18 @@ static char **break_line(const char *b, int *n)
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+/******************************************************************************/
+static void free_strs(char **b, int n)
+{
+    int i;
+
+    if ( b == NULL ) return;
+    for (i = 0; i < n; i++) free(b[i]);
+    free(b);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************/
 static int check_it(int csv, int idx)
 {
@@ -162,18 +298,64 @@ static int check_it(int csv, int idx)
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+/******************************************************************************
+ * Read ahead the first few lines and look at their time column.  With no     *
+ * time format given we work out the layout from them and set up the parser   *
+ * for it, failing if none fits; a given format is just checked against the   *
+ * first line.  The lines are kept to be handed out again by next_line.       *
+ ******************************************************************************/
+#define N_TIME_SAMPLES 8
+
+static int check_time_column(AED_CSV_IN *in, const char *timefmt)
+{
+    const char *times[N_TIME_SAMPLES];
+    char **b[N_TIME_SAMPLES], *ln;
+    int nb[N_TIME_SAMPLES];
+    int i, n = 0, ok = TRUE;
+
+    in->pending = malloc(N_TIME_SAMPLES * sizeof(char*));
+    while ( in->n_pending < N_TIME_SAMPLES && (ln = source_line(in)) != NULL ) {
+        in->pending[in->n_pending++] = strdup(ln);
+        b[n] = break_line(ln, &nb[n]);
+        if ( b[n] == NULL || nb[n] != in->n_cols || *b[n][0] == 0 )
+            free_strs(b[n], nb[n]);
+        else
+            times[n] = b[n][0], n++;
+    }
+
+    if ( n > 0 ) {
+        if ( timefmt != NULL ) {
+            if ( !check_time_formatted(times[0], in->tf) )
+                fprintf(stderr, "Time \"%s\" does not match the format \"%s\"\n",
+                                                                times[0], timefmt);
+        } else if ( (in->tf = guess_time_format(n, times)) == NULL ) {
+            fprintf(stderr, "Cannot work out the layout of times like \"%s\"\n", times[0]);
+            ok = FALSE;
+        }
+    }
+
+    for (i = 0; i < n; i++) free_strs(b[i], nb[i]);
+    return ok;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************
  *                                                                            *
  *                                                                            *
  ******************************************************************************/
-int open_csv_input(const char *fname, const char *timefmt)
+static int _open_csv_in(FILE *f, char *mem, size_t len, const char *timefmt)
 {
-    FILE *f = NULL;
+    AED_CSV_IN *in;
     int cols, i;
 
     if ( _n_inf < 0 ) {
         for (i = 0; i < MAX_IN_FILES; i++) {
             csv_if[i].f = NULL;
+            csv_if[i].mem = NULL;
+            csv_if[i].pending = NULL;
+            csv_if[i].n_pending = 0;
+            csv_if[i].next_pending = 0;
             csv_if[i].n_cols = 0;
             csv_if[i].header = NULL;
             csv_if[i].curLine = NULL;
@@ -184,25 +366,78 @@ int open_csv_input(const char *fname, const char *timefmt)
 
     if ( _n_inf >= MAX_IN_FILES ) {
         fprintf(stderr, "Too many csv_files open\n");
+        if ( f != NULL ) fclose(f);
+        return -1;
+    }
+
+    in = &csv_if[_n_inf];
+    in->f = f;
+    in->mem = mem;
+    in->mem_len = len;
+    in->mem_pos = 0;
+    in->pending = NULL;
+    in->n_pending = 0;
+    in->next_pending = 0;
+    in->header = break_line( next_line(in), &cols );
+    in->n_cols = cols;
+    in->curLine = malloc(sizeof(AED_REAL)*cols);
+    in->curTimeStr[0] = 0;
+    if (timefmt != NULL)
+        in->tf = decode_time_format(timefmt);
+    else
+        in->tf = NULL;
+
+    if ( !check_time_column(in, timefmt) ) {
+        close_csv_input(_n_inf);
         return -1;
     }
 
+    load_csv_line(_n_inf);
+    return _n_inf++;
+}
+/*----------------------------------------------------------------------------*/
+int open_csv_input(const char *fname, const char *timefmt)
+{
+    FILE *f = NULL;
+
     if ( (f = fopen(fname, "r")) == NULL ) {
         fprintf(stderr, "Cannot find file \"%s\"\n", fname);
         return -1;
     }
 
-    csv_if[_n_inf].f = f;
-    csv_if[_n_inf].header = break_line( read_line(f), &cols );
-    csv_if[_n_inf].n_cols = cols;
-    csv_if[_n_inf].curLine = malloc(sizeof(AED_REAL)*cols);
-    if (timefmt != NULL)
-        csv_if[_n_inf].tf = decode_time_format(timefmt);
-    else
-        csv_if[_n_inf].tf = NULL;
+    return _open_csv_in(f, NULL, 0, timefmt);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-    load_csv_line(_n_inf);
-    return _n_inf++;
+
+/******************************************************************************
+ * Read csv input from a caller owned buffer of len bytes.  The buffer is     *
+ * parsed in place (line ends are overwritten with nul characters), so it     *
+ * must be writable and must stay valid until close_csv_input.                *
+ ******************************************************************************/
+int open_csv_input_mem(char *buf, size_t len, const char *timefmt)
+{
+    if ( buf == NULL ) return -1;
+
+    return _open_csv_in(NULL, buf, len, timefmt);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Read csv input from an already open file descriptor, such as a pipe from   *
+ * an earlier stage.  The descriptor is closed by close_csv_input.            *
+ ******************************************************************************/
+int open_csv_input_fd(int fd, const char *timefmt)
+{
+    FILE *f = NULL;
+
+    if ( (f = fdopen(fd, "r")) == NULL ) {
+        fprintf(stderr, "Cannot read from file descriptor %d\n", fd);
+        return -1;
+    }
+
+    return _open_csv_in(f, NULL, 0, timefmt);
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
@@ -222,6 +457,15 @@ int close_csv_input(int csvf)
 
     if ( csv_if[csvf].f != NULL ) fclose(csv_if[csvf].f);
     csv_if[csvf].f = NULL;
+    csv_if[csvf].mem = NULL;
+    if ( csv_if[csvf].pending != NULL ) {
+        for (i = csv_if[csvf].next_pending ? csv_if[csvf].next_pending-1 : 0;
+                                              i < csv_if[csvf].n_pending; i++)
+            free(csv_if[csvf].pending[i]);
+        free(csv_if[csvf].pending);
+    }
+    csv_if[csvf].pending = NULL;
+    csv_if[csvf].n_pending = csv_if[csvf].next_pending = 0;
     if ( csv_if[csvf].header != NULL ) {
         for (i = 0; i < csv_if[csvf].n_cols; i++ )
             free(csv_if[csvf].header[i]);
@@ -231,10 +475,7 @@ int close_csv_input(int csvf)
     csv_if[csvf].header = NULL;
     if ( csv_if[csvf].curLine != NULL ) free(csv_if[csvf].curLine);
     csv_if[csvf].curLine = NULL;
-    if ( csv_if[csvf].tf != NULL) {
-        free(csv_if[csvf].tf->fmt);
-        free(csv_if[csvf].tf);
-    }
+    free_time_format(csv_if[csvf].tf);
     csv_if[csvf].tf = NULL;
 
     if ( csvf == _n_inf-1 ) _n_inf--;
@@ -287,6 +528,23 @@ int find_csv_var(int csv, const char *name)
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+/******************************************************************************
+ * Convert the time of the current line, as a Julian day in curLine[0] and    *
+ * exactly in curTime.                                                        *
+ ******************************************************************************/
+static void set_cur_time(AED_CSV_IN *in)
+{
+    int jul, secs;
+    double num;
+
+    in->curTime = read_time_secs(in->curTimeStr, in->tf);
+    time_to_jul(in->curTime, &jul, &secs);
+    num = secs; num /= 86400.0; num += jul;
+    in->curLine[0] = num;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************
  *                                                                            *
  *                                                                            *
@@ -295,8 +553,6 @@ int load_csv_line(int csv)
 {
     char **b = NULL;
     int    count, i, ret = TRUE;
-    double num;
-    int    jul, secs;
 
     if ( csv < 0 || csv > _n_inf ) {
         fprintf(stderr, "Request load for invalid csv file number\n");
@@ -307,17 +563,13 @@ int load_csv_line(int csv)
 #endif
     }
 
-    b = break_line(read_line(csv_if[csv].f), &count);
+    b = break_line(next_line(&csv_if[csv]), &count);
 
     if ( b == NULL || count != csv_if[csv].n_cols )
         ret = FALSE;
     else {
-        if (csv_if[csv].tf != NULL)
-            read_time_formatted(b[0], csv_if[csv].tf, &jul, &secs);
-        else
-            read_time_string(b[0], &jul, &secs);
-        num = secs; num /= 86400.0; num += jul;
-        csv_if[csv].curLine[0] = num;
+        strncpy(csv_if[csv].curTimeStr, b[0], sizeof(csv_if[csv].curTimeStr)-1);
+        set_cur_time(&csv_if[csv]);
         free(b[0]);
 
         for (i = 1; i < count; i++) {
@@ -371,6 +623,40 @@ AED_REAL get_csv_val_r(int csv, int idx)
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+/******************************************************************************
+ * Gather the values of n columns of the current line, idx[0..n-1], into      *
+ * out[0..n-1] with one call, for models reading many variables each step.    *
+ * The csv is checked once; a column out of range gives 0., as it does from   *
+ * get_csv_val_r.  Returns the number of columns that were in range.          *
+ ******************************************************************************/
+int get_csv_row_r(int csv, int n, const int *idx, AED_REAL *out)
+{
+    const AED_REAL *line;
+    unsigned int nc;
+    int i, ok = 0;
+
+    if ( csv < 0 || csv >= _n_inf ) {
+        for (i = 0; i < n; i++) out[i] = 0.;
+        return 0;
+    }
+    line = csv_if[csv].curLine;
+    nc = csv_if[csv].n_cols;
+
+    for (i = 0; i < n; i++) {
+        if ( (unsigned int)idx[i] < nc ) {
+            out[i] = line[idx[i]];
+            ok++;
+        } else
+            out[i] = 0.;
+    }
+    return ok;
+}
+/*----------------------------------------------------------------------------*/
+int get_csv_row_r_(int *csv, int *n, const int *idx, AED_REAL *out)
+{ return get_csv_row_r(*csv, *n, idx, out); }
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************
  *                                                                            *
  *                                                                            *
@@ -383,6 +669,43 @@ int get_csv_val_s(int csv, int idx, char *s)
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+/******************************************************************************
+ * The time of the current line of a csv input as an exact integer.           *
+ ******************************************************************************/
+aed_time_t get_csv_time(int csv)
+{
+    if ( csv < 0 || csv >= _n_inf ) return 0;
+    return csv_if[csv].curTime;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Read the times of csv input in another calendar (CAL_NOLEAP for a          *
+ * 365_day file, etc).  Julian days from the file are then that calendar's    *
+ * day numbers, to be taken apart with calendar_date_cal.  The current line   *
+ * is converted again, so this can be called straight after opening.          *
+ ******************************************************************************/
+int set_csv_calendar(int csv, int cal)
+{
+    AED_CSV_IN *in;
+
+    if ( csv < 0 || csv >= _n_inf || cal < 0 || cal >= N_CALENDARS ) {
+        fprintf(stderr, "Invalid calendar %d for csv file %d\n", cal, csv);
+        return -1;
+    }
+    in = &csv_if[csv];
+    if ( in->tf == NULL ) in->tf = decode_time_format("YYYY-MM-DD hh:mm:ss");
+    in->tf->cal = cal;
+    if ( in->curTimeStr[0] != 0 ) set_cur_time(in);
+    return 0;
+}
+/*----------------------------------------------------------------------------*/
+int set_csv_calendar_(int *csv, int *cal)
+{ return set_csv_calendar(*csv, *cal); }
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************
  *                                                                            *
  *                                                                            *
@@ -397,6 +720,178 @@ const char *get_csv_colname(int csv, int idx)
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+#ifndef _WIN32
+/******************************************************************************
+ * Publish a complete line into the shared memory ring.  This never waits on  *
+ * readers - a slow reader simply finds its rows have been overwritten.       *
+ ******************************************************************************/
+static void _shm_publish(AED_CSV_OUT *of)
+{
+    CSV_SHM_HDR *h = of->shm;
+    char *hdr_text = (char*)(h + 1);
+    char *slots = hdr_text + ((h->hdr_size + 7) & ~7);
+    CSV_SHM_SLOT *slot;
+    uint64_t row;
+    size_t len, max;
+    int cut;
+
+    max = ( of->in_header ) ? h->hdr_size - 1 : h->slot_size;
+    cut = of->line_cut || of->line_len > max;
+    len = ( cut ) ? max : of->line_len;
+    of->line_cut = FALSE;
+    if ( cut && !of->cut_warned ) {
+        fprintf(stderr, "Shared memory output \"%s\" : %s longer than %d bytes cut short\n",
+                 of->shm_name, (of->in_header) ? "header line" : "rows", (int)max);
+        of->cut_warned = TRUE;
+    }
+
+    if ( of->in_header ) {
+        __atomic_store_n(&h->hdr_seq, h->hdr_seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(hdr_text, of->line, len);
+        hdr_text[len] = 0;
+        h->hdr_cut = cut;
+        __atomic_store_n(&h->hdr_seq, h->hdr_seq + 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    row = h->seq;
+    slot = (CSV_SHM_SLOT*)(slots + (row % h->n_slots) * SHM_SLOT_BYTES(h->slot_size));
+
+    __atomic_store_n(&slot->seq, 2*row+1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(slot + 1, of->line, len);
+    slot->len = len;
+    slot->cut = cut;
+    __atomic_store_n(&slot->seq, 2*row+2, __ATOMIC_RELEASE);
+    __atomic_store_n(&h->seq, row+1, __ATOMIC_RELEASE);
+}
+/*----------------------------------------------------------------------------*/
+static void _shm_write(AED_CSV_OUT *of, const char *s, size_t len)
+{
+    size_t max = of->shm->slot_size;
+    const char *e;
+
+    if ( of->shm->hdr_size > max ) max = of->shm->hdr_size;
+
+    while ( len > 0 ) {
+        size_t n = len;
+        if ( (e = memchr(s, '\n', len)) != NULL ) n = e - s;
+        if ( of->line_len + n > max ) {
+            n = ( max > of->line_len ) ? max - of->line_len : 0;
+            of->line_cut = TRUE;
+        }
+        memcpy(of->line + of->line_len, s, n);
+        of->line_len += n;
+        if ( e == NULL ) return;
+        _shm_publish(of);
+        of->line_len = 0;
+        len -= (e - s) + 1;
+        s = e + 1;
+    }
+}
+#endif
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Text output goes through these so the same header and row code serves      *
+ * files and memory buffers.  Callback sinks take no text at all.             *
+ ******************************************************************************/
+static void _out_write(int f, const char *s, size_t len)
+{
+    AED_CSV_OUT *of = &csv_of[f];
+    size_t need;
+    char *b;
+
+    switch (of->kind) {
+        case OUT_FILE :
+            fwrite(s, 1, len, of->f);
+            break;
+        case OUT_MEM :
+            need = *of->mem_len + len + 1;
+            if ( need > of->mem_cap ) {
+                size_t cap = ( of->mem_cap ) ? of->mem_cap : BUFCHUNK;
+                while ( cap < need ) cap *= 2;
+                if ( (b = realloc(*of->mem, cap)) == NULL ) {
+                    fprintf(stderr, "Out of memory error\n");
+                    return;
+                }
+                *of->mem = b;
+                of->mem_cap = cap;
+            }
+            memcpy(*of->mem + *of->mem_len, s, len);
+            *of->mem_len += len;
+            (*of->mem)[*of->mem_len] = 0;
+            break;
+#ifndef _WIN32
+        case OUT_SHM :
+            _shm_write(of, s, len);
+            break;
+#endif
+    }
+}
+/*----------------------------------------------------------------------------*/
+static void _out_puts(int f, const char *s) { _out_write(f, s, strlen(s)); }
+static void _out_putc(int f, char c) { _out_write(f, &c, 1); }
+/*----------------------------------------------------------------------------*/
+static void _out_printf(int f, const char *fmt, ...)
+{
+    char tbuf[256], *t = tbuf;
+    va_list ap;
+    int len;
+
+    if ( csv_of[f].kind == OUT_FILE ) {
+        va_start(ap, fmt);
+        vfprintf(csv_of[f].f, fmt, ap);
+        va_end(ap);
+        return;
+    }
+
+    va_start(ap, fmt);
+    len = vsnprintf(tbuf, sizeof(tbuf), fmt, ap);
+    va_end(ap);
+    if ( len < 0 ) return;
+    if ( len >= (int)sizeof(tbuf) ) {
+        t = malloc(len+1);
+        va_start(ap, fmt);
+        vsnprintf(t, len+1, fmt, ap);
+        va_end(ap);
+    }
+    _out_write(f, t, len);
+    if ( t != tbuf ) free(t);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Claim the next output slot and reset its state.                            *
+ ******************************************************************************/
+static int _new_outf(int kind)
+{
+    AED_CSV_OUT *of;
+
+    if ( _n_outf >= MAX_OUT_FILES ) {
+        fprintf(stderr, "Too many csv output files open\n");
+        return -1;
+    }
+    of = &csv_of[_n_outf];
+    of->kind = kind;
+    of->f = NULL;
+    of->mem = NULL; of->mem_len = NULL; of->mem_cap = 0;
+    of->cb = NULL; of->cb_data = NULL;
+    of->shm = NULL; of->shm_size = 0; of->shm_name = NULL;
+    of->line = NULL; of->line_len = 0; of->in_header = FALSE;
+    of->line_cut = FALSE; of->cut_warned = FALSE;
+    of->n_vals = 0;
+    of->agg = CSV_AGG_NONE;
+    of->agg_period = 0;
+    of->agg_count = 0;
+    return _n_outf++;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************
  *                                                                            *
  *                                                                            *
@@ -405,6 +900,7 @@ int open_csv_output(const char *out_dir, const char *fname)
 {
     char *path = NULL;
     size_t len;
+    FILE *f;
     int ret = -1;
 
     if ( out_dir != NULL && strcmp(out_dir, ".") != 0 ) {
@@ -417,20 +913,22 @@ int open_csv_output(const char *out_dir, const char *fname)
         snprintf(path, len, "%s.csv", fname);
     }
 
-    if ( (csv_of[_n_outf].f = fopen(path, "w")) == NULL ) {
+    if ( (f = fopen(path, "w")) == NULL ) {
         fprintf(stderr, "Failed to open \"%s\"\n", path);
         ret = -1;
+    } else if ( (ret = _new_outf(OUT_FILE)) < 0 ) {
+        fclose(f);
     } else {
 #ifndef _WIN32
         struct stat stat;
-        fstat(fileno(csv_of[_n_outf].f), &stat);
+        fstat(fileno(f), &stat);
         if ( S_ISFIFO(stat.st_mode) ) {
             // at most buffer only lines in fifo pipes
-        //  setvbuf(csv_of[_n_outf].f, NULL, _IONBF, 0);
-            setlinebuf(csv_of[_n_outf].f);
+        //  setvbuf(f, NULL, _IONBF, 0);
+            setlinebuf(f);
         }
 #endif
-        ret = _n_outf++;
+        csv_of[ret].f = f;
     }
     free(path);
     return ret;
@@ -438,22 +936,162 @@ int open_csv_output(const char *out_dir, const char *fname)
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+/******************************************************************************
+ * Open an output that appends the csv text to a caller supplied buffer.      *
+ * *buf may be NULL or a malloc'd block; it is grown with realloc as needed   *
+ * and kept nul terminated, with the number of bytes written in *len.  The    *
+ * buffer remains the caller's to free after close_csv_output.                *
+ ******************************************************************************/
+int open_csv_output_mem(char **buf, size_t *len)
+{
+    int ret;
+
+    if ( buf == NULL || len == NULL ) return -1;
+    if ( (ret = _new_outf(OUT_MEM)) < 0 ) return -1;
+
+    csv_of[ret].mem = buf;
+    csv_of[ret].mem_len = len;
+    *len = 0;
+    if ( *buf != NULL ) **buf = 0;
+    return ret;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Open an output that hands each row to a callback instead of formatting it. *
+ * The callback gets the time string and the numeric values of the row, the   *
+ * values being in header order (not counting time).  Column names can be     *
+ * had from get_csv_out_colname.                                              *
+ ******************************************************************************/
+int open_csv_output_cb(csv_row_func cb, void *user)
+{
+    int ret;
+
+    if ( cb == NULL ) return -1;
+    if ( (ret = _new_outf(OUT_CALLBACK)) < 0 ) return -1;
+
+    csv_of[ret].cb = cb;
+    csv_of[ret].cb_data = user;
+    return ret;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Open an output that publishes each row into a POSIX shared memory ring of  *
+ * n_slots rows of up to slot_size bytes (0 for either picks a default).      *
+ * Viewers attach with open_csv_shm_reader and tail it without locks; the     *
+ * writer never waits for them.  A segment of the same name left from an      *
+ * earlier run is unlinked first, so any viewer still attached to it keeps    *
+ * the old one and the new ring always starts empty.  The segment is          *
+ * unlinked on close.                                                         *
+ ******************************************************************************/
+int open_csv_output_shm(const char *name, int n_slots, int slot_size)
+{
+#ifndef _WIN32
+    AED_CSV_OUT *of;
+    CSV_SHM_HDR *h;
+    size_t size, hdr_size;
+    uint64_t magic;
+    char *nm;
+    int fd, ret;
+
+    if ( name == NULL || *name == 0 ) return -1;
+    if ( n_slots <= 0 ) n_slots = 1024;
+    if ( slot_size <= 0 ) slot_size = bufsize;
+    hdr_size = 4 * (size_t)slot_size;
+    size = SHM_TOTAL(n_slots, slot_size, hdr_size);
+
+    nm = malloc(strlen(name) + 2);
+    sprintf(nm, "%s%s", (*name == '/') ? "" : "/", name);
+
+    shm_unlink(nm);
+    if ( (fd = shm_open(nm, O_CREAT | O_EXCL | O_RDWR, 0644)) < 0 ) {
+        fprintf(stderr, "Failed to create shared memory \"%s\"\n", nm);
+        free(nm);
+        return -1;
+    }
+    if ( ftruncate(fd, size) != 0 ||
+         (h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED ) {
+        fprintf(stderr, "Failed to map shared memory \"%s\"\n", nm);
+        close(fd); shm_unlink(nm); free(nm);
+        return -1;
+    }
+    close(fd);
+
+    if ( (ret = _new_outf(OUT_SHM)) < 0 ) {
+        munmap(h, size); shm_unlink(nm); free(nm);
+        return -1;
+    }
+
+    memset(h, 0, sizeof(CSV_SHM_HDR));
+    h->n_slots = n_slots;
+    h->slot_size = slot_size;
+    h->hdr_size = hdr_size;
+    /* readers check the magic first, so it goes in last, after the sizes */
+    memcpy(&magic, SHM_MAGIC, 8);
+    __atomic_store_n((uint64_t*)h->magic, magic, __ATOMIC_RELEASE);
+
+    of = &csv_of[ret];
+    of->shm = h;
+    of->shm_size = size;
+    of->shm_name = nm;
+    of->line = malloc(hdr_size);
+    return ret;
+#else
+    fprintf(stderr, "Shared memory output is not supported on this system\n");
+    return -1;
+#endif
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************
  *                                                                            *
  *                                                                            *
  ******************************************************************************/
 int close_csv_output(int outf)
 {
-    int ret;
+    int ret = 0;
 
     if ( outf < 0 || outf >= MAX_OUT_FILES ) return -1;
-    ret = fclose(csv_of[outf].f);
+    if ( csv_of[outf].kind == OUT_CLOSED ) return -1;
+    if ( csv_of[outf].agg != CSV_AGG_NONE && csv_of[outf].agg != CSV_AGG_NTH &&
+         csv_of[outf].agg_count > 0 )
+        _flush_agg(outf);
+    if ( csv_of[outf].f != NULL ) ret = fclose(csv_of[outf].f);
     csv_of[outf].f = NULL;
+#ifndef _WIN32
+    if ( csv_of[outf].shm != NULL ) {
+        munmap(csv_of[outf].shm, csv_of[outf].shm_size);
+        shm_unlink(csv_of[outf].shm_name);
+        free(csv_of[outf].shm_name);
+        free(csv_of[outf].line);
+        csv_of[outf].shm = NULL;
+        csv_of[outf].shm_name = NULL;
+        csv_of[outf].line = NULL;
+    }
+#endif
+    csv_of[outf].kind = OUT_CLOSED;
     return ret;
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+/******************************************************************************
+ *                                                                            *
+ ******************************************************************************/
+const char *get_csv_out_colname(int f, int idx)
+{
+    if ( f < 0 || f >= _n_outf ) return NULL;
+    if ( idx < 0 || idx >= csv_of[f].n_cols ) return NULL;
+
+    return (const char*)(csv_of[f].header[idx]);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************
  *                                                                            *
  *                                                                            *
@@ -473,7 +1111,8 @@ static void _add_header(char ***hdrs, int *n, const char *name)
 /*----------------------------------------------------------------------------*/
 void csv_header_start(int f)
 {
-    fputs("time", csv_of[f].f);
+    csv_of[f].in_header = TRUE;
+    _out_puts(f, "time");
     csv_of[f].n_cols = 0;
     _add_header(&csv_of[f].header, &csv_of[f].n_cols, "time");
     strcpy(csv_of[f].time, "INVALID");
@@ -481,21 +1120,22 @@ void csv_header_start(int f)
 /*----------------------------------------------------------------------------*/
 void csv_header_var(int f, const char *v)
 {
-    fprintf(csv_of[f].f, ",%s", v);
+    _out_printf(f, ",%s", v);
     csv_of[f].buff[csv_of[f].n_cols] = missing;
     _add_header(&csv_of[f].header, &csv_of[f].n_cols, v);
 }
 /*----------------------------------------------------------------------------*/
 void csv_header_var2(int f, const char *v, const char *units)
 {
-    fprintf(csv_of[f].f, ",%s [%s]", v, units);
+    _out_printf(f, ",%s [%s]", v, units);
     csv_of[f].buff[csv_of[f].n_cols] = missing;
     _add_header(&csv_of[f].header, &csv_of[f].n_cols, v);
 }
 /*----------------------------------------------------------------------------*/
 void csv_header_end(int f)
 {
-    fputc('\n', csv_of[f].f);
+    _out_putc(f, '\n');
+    csv_of[f].in_header = FALSE;
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
@@ -504,9 +1144,135 @@ void csv_header_end(int f)
  *                                                                            *
  *                                                                            *
  ******************************************************************************/
-void write_csv_start(int f, const char *cval) { fputs(cval, csv_of[f].f); }
-void write_csv_val(int f, AED_REAL val) { fprintf(csv_of[f].f, ",%15.6f", val); }
-void write_csv_end(int f) { fputc('\n', csv_of[f].f); }
+void write_csv_start(int f, const char *cval)
+{
+    if ( csv_of[f].kind == OUT_CALLBACK ) {
+        strncpy(csv_of[f].time, cval, 19); csv_of[f].time[19] = 0;
+        csv_of[f].n_vals = 0;
+    } else
+        _out_puts(f, cval);
+}
+/*----------------------------------------------------------------------------*/
+void write_csv_val(int f, AED_REAL val)
+{
+    if ( csv_of[f].kind == OUT_CALLBACK ) {
+        if ( csv_of[f].n_vals < MAX_OUT_VALUES+3 )
+            csv_of[f].buff[++csv_of[f].n_vals] = val;
+    } else
+        _out_printf(f, ",%15.6f", val);
+}
+/*----------------------------------------------------------------------------*/
+void write_csv_end(int f)
+{
+    if ( csv_of[f].kind == OUT_CALLBACK ) {
+        csv_of[f].cb(csv_of[f].cb_data, csv_of[f].time,
+                     csv_of[f].n_vals, &csv_of[f].buff[1]);
+        csv_of[f].n_vals = 0;
+    } else
+        _out_putc(f, '\n');
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Select a temporal reduction for rows written through write_csv_var.        *
+ * For CSV_AGG_NTH only every period'th row is written; for the others the    *
+ * rows are accumulated per column and one row is written for each period     *
+ * seconds of model time, labelled with the start of that period.  Missing    *
+ * values are left out of the reduction.                                      *
+ ******************************************************************************/
+int set_csv_output_agg(int f, int mode, int period)
+{
+    int i;
+
+    if ( f < 0 || f >= _n_outf || csv_of[f].kind == OUT_CLOSED ) return -1;
+    if ( mode < CSV_AGG_NONE || mode > CSV_AGG_SUM ) return -1;
+    if ( mode != CSV_AGG_NONE && period <= 0 ) return -1;
+
+    csv_of[f].agg = mode;
+    csv_of[f].agg_period = period;
+    csv_of[f].agg_count = 0;
+    csv_of[f].agg_key = 0;
+    init_time_cache(&csv_of[f].agg_tc, NULL);
+    for (i = 0; i < MAX_OUT_VALUES+4; i++) {
+        csv_of[f].agg_val[i] = 0.;
+        csv_of[f].agg_n[i] = 0;
+    }
+    return 0;
+}
+/*----------------------------------------------------------------------------*/
+static void _write_row(int f, const char *time, const AED_REAL *vals)
+{
+    int i;
+
+    if ( csv_of[f].kind == OUT_CALLBACK ) {
+        csv_of[f].cb(csv_of[f].cb_data, time, csv_of[f].n_cols-1, &vals[1]);
+        return;
+    }
+
+    _out_puts(f, time);
+
+    for (i = 1; i < csv_of[f].n_cols; i++)
+        _out_printf(f, ",%12.6f", vals[i]);
+
+    _out_putc(f, '\n');
+}
+/*----------------------------------------------------------------------------*/
+static void _flush_agg(int f)
+{
+    AED_CSV_OUT *of = &csv_of[f];
+    AED_REAL vals[MAX_OUT_VALUES+4];
+    int i, jul, secs;
+
+    for (i = 1; i < of->n_cols; i++) {
+        if ( of->agg_n[i] == 0 )
+            vals[i] = missing;
+        else if ( of->agg == CSV_AGG_MEAN )
+            vals[i] = of->agg_val[i] / of->agg_n[i];
+        else
+            vals[i] = of->agg_val[i];
+        of->agg_val[i] = 0.;
+        of->agg_n[i] = 0;
+    }
+
+    time_to_jul(of->agg_key * of->agg_period, &jul, &secs);
+    write_time_cached(NULL, &of->agg_tc, jul, secs);
+    _write_row(f, of->agg_tc.str, vals);
+    of->agg_count = 0;
+}
+/*----------------------------------------------------------------------------*/
+static void _agg_row(int f)
+{
+    AED_CSV_OUT *of = &csv_of[f];
+    aed_time_t key;
+    int i;
+
+    if ( of->agg == CSV_AGG_NTH ) {
+        if ( (of->agg_count++ % of->agg_period) == 0 )
+            _write_row(f, of->time, of->buff);
+        return;
+    }
+
+    key = read_time_secs(of->time, NULL) / of->agg_period;
+
+    if ( of->agg_count > 0 && key != of->agg_key ) _flush_agg(f);
+    of->agg_key = key;
+    of->agg_count++;
+
+    for (i = 1; i < of->n_cols; i++) {
+        AED_REAL v = of->buff[i];
+
+        if ( v == missing ) continue;
+        if ( of->agg_n[i] == 0 )
+            of->agg_val[i] = v;
+        else switch (of->agg) {
+            case CSV_AGG_MIN : if ( v < of->agg_val[i] ) of->agg_val[i] = v; break;
+            case CSV_AGG_MAX : if ( v > of->agg_val[i] ) of->agg_val[i] = v; break;
+            default          : of->agg_val[i] += v; break;
+        }
+        of->agg_n[i]++;
+    }
+}
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
@@ -517,7 +1283,7 @@ void write_csv_var(int f, const char *name, AED_REAL val, const char *cval, int
 {
     int i;
 
-    if ( csv_of[f].f == NULL ) return;
+    if ( csv_of[f].kind == OUT_CLOSED ) return;
 
     if (strcasecmp(name, "time") == 0) {
         strncpy(csv_of[f].time, cval, 19); csv_of[f].time[19] = 0;
@@ -532,12 +1298,10 @@ void write_csv_var(int f, const char *name, AED_REAL val, const char *cval, int
     }
 
     if (last && (strcasecmp(csv_of[f].time, "INVALID") != 0)) {
-        fputs(csv_of[f].time, csv_of[f].f);
-
-        for (i = 1; i < csv_of[f].n_cols; i++)
-            fprintf(csv_of[f].f, ",%12.6f", csv_of[f].buff[i]);
-
-        fputc('\n', csv_of[f].f);
+        if ( csv_of[f].agg == CSV_AGG_NONE )
+            _write_row(f, csv_of[f].time, csv_of[f].buff);
+        else
+            _agg_row(f);
 
         strcpy(csv_of[f].time, "INVALID");
         for (i = 0; i < csv_of[f].n_cols; i++)
@@ -547,14 +1311,436 @@ void write_csv_var(int f, const char *name, AED_REAL val, const char *cval, int
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+/******************************************************************************
+ * Matrix outputs write a whole profile - one value per layer - each step.    *
+ * The column labels are built once at open and each row is formatted in a    *
+ * single pass into one buffer, so a profile of any length costs one write    *
+ * and no name lookups.  A binary matrix starts with an AED_MTX_HDR and the   *
+ * header line, then has one block per row of the time in seconds followed    *
+ * by the n values as AED_REAL.                                               *
+ ******************************************************************************/
+#define MTX_MAGIC     "AEDMTX01"
+
+typedef struct _AED_MTX_HDR {
+    char     magic[8];
+    uint32_t n_cols;         /* values per row, not counting time */
+    uint32_t value_size;     /* sizeof(AED_REAL) of the writer */
+    uint32_t endian;         /* 0x01020304 as written by the writer */
+    uint32_t hdr_len;        /* bytes of header line that follow */
+} AED_MTX_HDR;
+
+typedef struct _AED_CSV_MTX {
+    FILE    *f;
+    int      binary;
+    int      n;
+    char    *line;        /* the row being formatted */
+    size_t   line_cap;
+    timecache tc;
+} AED_CSV_MTX;
+
+static int _n_mtx = 0;
+static AED_CSV_MTX csv_mx[MAX_OUT_FILES];
+
+/*----------------------------------------------------------------------------*/
+static int _check_mtx(int m)
+{
+    if ( m < 0 || m >= _n_mtx || csv_mx[m].f == NULL ) {
+        fprintf(stderr, "Invalid matrix output %d\n", m);
+        return FALSE;
+    }
+    return TRUE;
+}
+/*----------------------------------------------------------------------------*/
+static char *_grow_line(AED_CSV_MTX *mx, char *p, size_t more)
+{
+    size_t used = p - mx->line, cap = mx->line_cap;
+    char *b;
+
+    if ( used + more <= cap ) return p;
+    while ( cap < used + more ) cap *= 2;
+    if ( (b = realloc(mx->line, cap)) == NULL ) {
+        fprintf(stderr, "Out of memory error\n");
+        return NULL;
+    }
+    mx->line = b;
+    mx->line_cap = cap;
+    return b + used;
+}
+/*----------------------------------------------------------------------------*/
+/*
+ * Append val as ",%15.6f" would print it.  Values that are not finite, too
+ * big to scale exactly or too near a rounding tie are left to sprintf, so
+ * the text is always the same as write_csv_val writes.
+ */
+static char *_put_fixed(char *p, AED_REAL val)
+{
+    double v = val, a = fabs(v) * 1e6, f;
+    uint64_t r, ip;
+    char dig[24], *d = dig + sizeof(dig);
+    int i, w;
+
+    if ( !isfinite(v) || fabs(v) >= 1e9 ) return p + sprintf(p, ",%15.6f", v);
+    r = (uint64_t)a;
+    f = a - (double)r;
+    if ( f > 0.4999 && f < 0.5001 ) return p + sprintf(p, ",%15.6f", v);
+    if ( f > 0.5 ) r++;
+
+    ip = r / 1000000;
+    r -= ip * 1000000;
+    for (i = 0; i < 6; i++) { *--d = '0' + (r % 10); r /= 10; }
+    *--d = '.';
+    do { *--d = '0' + (ip % 10); ip /= 10; } while ( ip > 0 );
+    if ( signbit(v) ) *--d = '-';
+
+    w = (dig + sizeof(dig)) - d;
+    *p++ = ',';
+    for (i = w; i < 15; i++) *p++ = ' ';
+    memcpy(p, d, w);
+    return p + w;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Open a matrix output of n values per row in out_dir/fname.csv, or in       *
+ * out_dir/fname.bin if binary is set.  The columns are labelled var_1 to     *
+ * var_n after the time column.  Returns a handle for write_csv_matrix.       *
+ ******************************************************************************/
+int open_csv_matrix(const char *out_dir, const char *fname,
+                                       const char *var, int n, int binary)
+{
+    AED_CSV_MTX *mx;
+    AED_MTX_HDR h;
+    char *path, *p;
+    size_t len;
+    FILE *f;
+    int i, m;
+
+    if ( fname == NULL || var == NULL || n <= 0 ) return -1;
+
+    for (m = 0; m < _n_mtx; m++)
+        if ( csv_mx[m].f == NULL ) break;
+    if ( m >= MAX_OUT_FILES ) {
+        fprintf(stderr, "Too many csv matrix outputs open\n");
+        return -1;
+    }
+
+    len = ((out_dir != NULL) ? strlen(out_dir) + strlen(DIRSEP) : 0) + strlen(fname) + 5;
+    path = malloc(len);
+    if ( out_dir != NULL && strcmp(out_dir, ".") != 0 )
+        snprintf(path, len, "%s%s%s.%s", out_dir, DIRSEP, fname, binary ? "bin" : "csv");
+    else
+        snprintf(path, len, "%s.%s", fname, binary ? "bin" : "csv");
+
+    if ( (f = fopen(path, binary ? "wb" : "w")) == NULL ) {
+        fprintf(stderr, "Failed to open \"%s\"\n", path);
+        free(path);
+        return -1;
+    }
+    free(path);
+
+    mx = &csv_mx[m];
+    mx->binary = binary;
+    mx->n = n;
+    /* room for the header line, a row of text or a binary row block */
+    mx->line_cap = (size_t)n * (strlen(var) + 16) + 64;
+    if ( (mx->line = malloc(mx->line_cap)) == NULL ) {
+        fprintf(stderr, "Out of memory error\n");
+        fclose(f);
+        return -1;
+    }
+
+    p = mx->line + sprintf(mx->line, "time");
+    for (i = 1; i <= n; i++)
+        p += sprintf(p, ",%s_%d", var, i);
+    *p++ = '\n';
+
+    if ( binary ) {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, MTX_MAGIC, 8);
+        h.n_cols = n;
+        h.value_size = sizeof(AED_REAL);
+        h.endian = 0x01020304;
+        h.hdr_len = p - mx->line;
+        fwrite(&h, sizeof(h), 1, f);
+    }
+    fwrite(mx->line, 1, p - mx->line, f);
+
+    init_time_cache(&mx->tc, NULL);
+    mx->f = f;
+    if ( m == _n_mtx ) _n_mtx++;
+    return m;
+}
+/*----------------------------------------------------------------------------*/
+static char *_fstr(const char *s, int len)
+{
+    char *c = malloc(len + 1);
+
+    while ( len > 0 && s[len-1] == ' ' ) len--;
+    memcpy(c, s, len);
+    c[len] = 0;
+    return c;
+}
+/*----------------------------------------------------------------------------*/
+int open_csv_matrix_(const char *out_dir, int *l1, const char *fname, int *l2,
+                     const char *var, int *l3, int *n, int *binary)
+{
+    char *d = _fstr(out_dir, *l1), *f = _fstr(fname, *l2), *v = _fstr(var, *l3);
+    int ret = open_csv_matrix(d, f, v, *n, *binary);
+
+    free(d); free(f); free(v);
+    return ret;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Write one row of a matrix output : the time t and the n values in vals.    *
+ * Returns 0, or -1 if the handle is not open or the write failed.            *
+ ******************************************************************************/
+int write_csv_matrix(int m, aed_time_t t, const AED_REAL *vals)
+{
+    AED_CSV_MTX *mx;
+    size_t len;
+    char *p;
+    int i, jul, secs;
+
+    if ( !_check_mtx(m) ) return -1;
+    mx = &csv_mx[m];
+
+    if ( mx->binary ) {
+        memcpy(mx->line, &t, sizeof(t));
+        memcpy(mx->line + sizeof(t), vals, sizeof(AED_REAL) * mx->n);
+        len = sizeof(t) + sizeof(AED_REAL) * mx->n;
+        return ( fwrite(mx->line, 1, len, mx->f) == len ) ? 0 : -1;
+    }
+
+    time_to_jul(t, &jul, &secs);
+    write_time_cached(NULL, &mx->tc, jul, secs);
+
+    len = strlen(mx->tc.str);
+    memcpy(mx->line, mx->tc.str, len);
+    p = mx->line + len;
+    for (i = 0; i < mx->n; i++) {
+        /* the fast path writes 16 bytes, sprintf at most a few hundred */
+        if ( (p = _grow_line(mx, p, 400)) == NULL ) return -1;
+        p = _put_fixed(p, vals[i]);
+    }
+    *p++ = '\n';
+
+    len = p - mx->line;
+    return ( fwrite(mx->line, 1, len, mx->f) == len ) ? 0 : -1;
+}
+/*----------------------------------------------------------------------------*/
+int write_csv_matrix_(int *m, int *jul, int *secs, const AED_REAL *vals)
+{
+    return write_csv_matrix(*m, time_from_jul(*jul, *secs), vals);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ *                                                                            *
+ ******************************************************************************/
+int close_csv_matrix(int m)
+{
+    int ret;
+
+    if ( !_check_mtx(m) ) return -1;
+
+    ret = fclose(csv_mx[m].f);
+    csv_mx[m].f = NULL;
+    free(csv_mx[m].line);
+    csv_mx[m].line = NULL;
+    return ret;
+}
+/*----------------------------------------------------------------------------*/
+int close_csv_matrix_(int *m)
+{
+    return close_csv_matrix(*m);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * The reading side of the shared memory ring, for viewers.                   *
+ ******************************************************************************/
+typedef struct _CSV_SHM_IN {
+    CSV_SHM_HDR *shm;
+    size_t   size;
+    uint64_t next;           /* the next row this reader wants */
+    int      cut;            /* the line last read was cut short */
+} CSV_SHM_IN;
+
+static CSV_SHM_IN csv_shm_in[MAX_IN_FILES];
+
+/*----------------------------------------------------------------------------*/
+int open_csv_shm_reader(const char *name)
+{
+#ifndef _WIN32
+    CSV_SHM_HDR *h;
+    struct stat st;
+    uint64_t magic;
+    char *nm;
+    int fd, i;
+
+    for (i = 0; i < MAX_IN_FILES; i++)
+        if ( csv_shm_in[i].shm == NULL ) break;
+    if ( i >= MAX_IN_FILES ) {
+        fprintf(stderr, "Too many shared memory readers open\n");
+        return -1;
+    }
+
+    nm = malloc(strlen(name) + 2);
+    sprintf(nm, "%s%s", (*name == '/') ? "" : "/", name);
+    fd = shm_open(nm, O_RDONLY, 0);
+    free(nm);
+    if ( fd < 0 ) return -1;
+
+    if ( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CSV_SHM_HDR) ||
+         (h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED ) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    /* the sizes are only good once the magic is seen to be there */
+    magic = __atomic_load_n((uint64_t*)h->magic, __ATOMIC_ACQUIRE);
+    if ( memcmp(&magic, SHM_MAGIC, 8) != 0 || h->n_slots == 0 || h->slot_size == 0 ||
+         (size_t)st.st_size < SHM_TOTAL(h->n_slots, h->slot_size, h->hdr_size) ) {
+        munmap(h, st.st_size);
+        return -1;
+    }
+
+    csv_shm_in[i].shm = h;
+    csv_shm_in[i].size = st.st_size;
+    csv_shm_in[i].next = 0;
+    csv_shm_in[i].cut = FALSE;
+    return i;
+#else
+    return -1;
+#endif
+}
+/*----------------------------------------------------------------------------*/
+void close_csv_shm_reader(int r)
+{
+#ifndef _WIN32
+    if ( r < 0 || r >= MAX_IN_FILES || csv_shm_in[r].shm == NULL ) return;
+    munmap(csv_shm_in[r].shm, csv_shm_in[r].size);
+    csv_shm_in[r].shm = NULL;
+#endif
+}
+/*----------------------------------------------------------------------------*/
+#ifndef _WIN32
+static int _shm_copy(const char *src, uint64_t *seqp, uint64_t want,
+                            size_t len, char *line, int maxlen)
+{
+    uint64_t s1, s2;
+
+    s1 = __atomic_load_n(seqp, __ATOMIC_ACQUIRE);
+    if ( s1 != want ) return -1;
+    if ( len > (size_t)maxlen - 1 ) len = maxlen - 1;
+    memcpy(line, src, len);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    s2 = __atomic_load_n(seqp, __ATOMIC_RELAXED);
+    if ( s1 != s2 ) return -1;
+    line[len] = 0;
+    return len;
+}
+#endif
+/*----------------------------------------------------------------------------*/
+int read_csv_shm_header(int r, char *line, int maxlen)
+{
+#ifndef _WIN32
+    CSV_SHM_HDR *h;
+    uint64_t hs;
+    int n;
+
+    if ( r < 0 || r >= MAX_IN_FILES || (h = csv_shm_in[r].shm) == NULL ) return -1;
+    if ( maxlen <= 0 ) return -1;
+
+    hs = __atomic_load_n(&h->hdr_seq, __ATOMIC_ACQUIRE);
+    if ( hs == 0 || (hs & 1) ) return 0;
+    csv_shm_in[r].cut = h->hdr_cut;
+    n = _shm_copy((char*)(h + 1), &h->hdr_seq, hs, strnlen((char*)(h + 1), h->hdr_size),
+                                                                           line, maxlen);
+    return ( n < 0 ) ? 0 : n;
+#else
+    return -1;
+#endif
+}
+/*----------------------------------------------------------------------------*/
+/* Copy the next unread row into line.  Returns its length, 0 if there is no  */
+/* new row yet, or -1 for a bad reader.  A reader that falls more than a ring */
+/* behind skips ahead to the oldest row still held.                           */
+/*----------------------------------------------------------------------------*/
+int read_csv_shm(int r, char *line, int maxlen)
+{
+#ifndef _WIN32
+    CSV_SHM_IN *in;
+    CSV_SHM_HDR *h;
+    CSV_SHM_SLOT *slot;
+    char *slots;
+    uint64_t head;
+    int n;
+
+    if ( r < 0 || r >= MAX_IN_FILES || (h = csv_shm_in[r].shm) == NULL ) return -1;
+    if ( maxlen <= 0 ) return -1;
+    in = &csv_shm_in[r];
+    slots = (char*)(h + 1) + ((h->hdr_size + 7) & ~7);
+
+    for (;;) {
+        head = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE);
+        if ( in->next >= head ) return 0;
+        if ( head - in->next > h->n_slots ) in->next = head - h->n_slots;
+
+        slot = (CSV_SHM_SLOT*)(slots + (in->next % h->n_slots) * SHM_SLOT_BYTES(h->slot_size));
+        in->cut = slot->cut;
+        n = _shm_copy((char*)(slot + 1), &slot->seq, 2*in->next+2,
+                                       slot->len, line, maxlen);
+        if ( n >= 0 ) { in->next++; return n; }
+
+        /* overwritten while we looked, go round again from the new head */
+        in->next++;
+    }
+#else
+    return -1;
+#endif
+}
+/*----------------------------------------------------------------------------*/
+/* TRUE if the writer had to cut short the line last read, which then holds   */
+/* only the first slot_size (or header size) bytes of it.                     */
+/*----------------------------------------------------------------------------*/
+int read_csv_shm_cut(int r)
+{
+    if ( r < 0 || r >= MAX_IN_FILES || csv_shm_in[r].shm == NULL ) return FALSE;
+    return csv_shm_in[r].cut;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Read forward until the current line is at or after time t.  Returns FALSE  *
+ * if the end of the file is reached first.                                   *
+ ******************************************************************************/
+int find_csv_time(int csv, aed_time_t t)
+{
+    if ( csv < 0 || csv >= _n_inf ) return FALSE;
+
+    while ( csv_if[csv].curTime < t )
+        if ( !load_csv_line(csv) ) return FALSE;
+    return TRUE;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************
  *                                                                            *
  *                                                                            *
  ******************************************************************************/
 void find_day(int csv, int time_idx, int jday)
 {
-    int y,m,d;
-    AED_REAL tr;
+    int y,m,d,found;
 
     if ( !check_it(csv, time_idx) ) {
         fprintf(stderr, "Fatal error in find_day: file %d index %d\n", csv, time_idx);
@@ -565,16 +1751,23 @@ void find_day(int csv, int time_idx, int jday)
 #endif
     }
 
-    while( (tr = get_csv_val_r(csv, time_idx)) < jday) {
-        if ( !load_csv_line(csv) ) {
-            calendar_date(jday, &y, &m, &d);
-            fprintf(stderr,"Day %d (%d-%02d-%02d) not found\n", jday, y, m, d);
+    if ( time_idx == 0 )
+        found = find_csv_time(csv, time_from_jul(jday, 0));
+    else {
+        found = TRUE;
+        while ( found && get_csv_val_r(csv, time_idx) < jday )
+            found = load_csv_line(csv);
+    }
+
+    if ( !found ) {
+        calendar_date_cal(( csv_if[csv].tf != NULL ) ? csv_if[csv].tf->cal : CAL_GREGORIAN,
+                                                             jday, &y, &m, &d);
+        fprintf(stderr,"Day %d (%d-%02d-%02d) not found\n", jday, y, m, d);
 #if DEBUG
-            CRASH("find_day");
+        CRASH("find_day");
 #else
-            exit(1);
+        exit(1);
 #endif
-        }
     }
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
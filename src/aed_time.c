@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
 
 #include "libutil.h"
@@ -37,10 +38,176 @@
 
 
 
+/******************************************************************************
+ * Lookup tables for the years TBL_YEAR0 to TBL_YEAR0+TBL_NYEARS-1 : the      *
+ * Julian day of each 1st of January, the days before each month and the      *
+ * month each day of the year falls in.  They are constant, so the functions  *
+ * that use them stay pure and safe to call from any thread.  _ystart[i] is   *
+ * _julian_day_arith(TBL_YEAR0+i, 1, 1); outside the table we fall back to    *
+ * the arithmetic.                                                            *
+ ******************************************************************************/
+#define TBL_YEAR0    1700
+#define TBL_NYEARS   700
+
+static const int _ystart[TBL_NYEARS+1] = {
+    2341973, 2342338, 2342703, 2343068, 2343433, 2343799, 2344164, 2344529,
+    2344894, 2345260, 2345625, 2345990, 2346355, 2346721, 2347086, 2347451,
+    2347816, 2348182, 2348547, 2348912, 2349277, 2349643, 2350008, 2350373,
+    2350738, 2351104, 2351469, 2351834, 2352199, 2352565, 2352930, 2353295,
+    2353660, 2354026, 2354391, 2354756, 2355121, 2355487, 2355852, 2356217,
+    2356582, 2356948, 2357313, 2357678, 2358043, 2358409, 2358774, 2359139,
+    2359504, 2359870, 2360235, 2360600, 2360965, 2361331, 2361696, 2362061,
+    2362426, 2362792, 2363157, 2363522, 2363887, 2364253, 2364618, 2364983,
+    2365348, 2365714, 2366079, 2366444, 2366809, 2367175, 2367540, 2367905,
+    2368270, 2368636, 2369001, 2369366, 2369731, 2370097, 2370462, 2370827,
+    2371192, 2371558, 2371923, 2372288, 2372653, 2373019, 2373384, 2373749,
+    2374114, 2374480, 2374845, 2375210, 2375575, 2375941, 2376306, 2376671,
+    2377036, 2377402, 2377767, 2378132, 2378497, 2378862, 2379227, 2379592,
+    2379957, 2380323, 2380688, 2381053, 2381418, 2381784, 2382149, 2382514,
+    2382879, 2383245, 2383610, 2383975, 2384340, 2384706, 2385071, 2385436,
+    2385801, 2386167, 2386532, 2386897, 2387262, 2387628, 2387993, 2388358,
+    2388723, 2389089, 2389454, 2389819, 2390184, 2390550, 2390915, 2391280,
+    2391645, 2392011, 2392376, 2392741, 2393106, 2393472, 2393837, 2394202,
+    2394567, 2394933, 2395298, 2395663, 2396028, 2396394, 2396759, 2397124,
+    2397489, 2397855, 2398220, 2398585, 2398950, 2399316, 2399681, 2400046,
+    2400411, 2400777, 2401142, 2401507, 2401872, 2402238, 2402603, 2402968,
+    2403333, 2403699, 2404064, 2404429, 2404794, 2405160, 2405525, 2405890,
+    2406255, 2406621, 2406986, 2407351, 2407716, 2408082, 2408447, 2408812,
+    2409177, 2409543, 2409908, 2410273, 2410638, 2411004, 2411369, 2411734,
+    2412099, 2412465, 2412830, 2413195, 2413560, 2413926, 2414291, 2414656,
+    2415021, 2415386, 2415751, 2416116, 2416481, 2416847, 2417212, 2417577,
+    2417942, 2418308, 2418673, 2419038, 2419403, 2419769, 2420134, 2420499,
+    2420864, 2421230, 2421595, 2421960, 2422325, 2422691, 2423056, 2423421,
+    2423786, 2424152, 2424517, 2424882, 2425247, 2425613, 2425978, 2426343,
+    2426708, 2427074, 2427439, 2427804, 2428169, 2428535, 2428900, 2429265,
+    2429630, 2429996, 2430361, 2430726, 2431091, 2431457, 2431822, 2432187,
+    2432552, 2432918, 2433283, 2433648, 2434013, 2434379, 2434744, 2435109,
+    2435474, 2435840, 2436205, 2436570, 2436935, 2437301, 2437666, 2438031,
+    2438396, 2438762, 2439127, 2439492, 2439857, 2440223, 2440588, 2440953,
+    2441318, 2441684, 2442049, 2442414, 2442779, 2443145, 2443510, 2443875,
+    2444240, 2444606, 2444971, 2445336, 2445701, 2446067, 2446432, 2446797,
+    2447162, 2447528, 2447893, 2448258, 2448623, 2448989, 2449354, 2449719,
+    2450084, 2450450, 2450815, 2451180, 2451545, 2451911, 2452276, 2452641,
+    2453006, 2453372, 2453737, 2454102, 2454467, 2454833, 2455198, 2455563,
+    2455928, 2456294, 2456659, 2457024, 2457389, 2457755, 2458120, 2458485,
+    2458850, 2459216, 2459581, 2459946, 2460311, 2460677, 2461042, 2461407,
+    2461772, 2462138, 2462503, 2462868, 2463233, 2463599, 2463964, 2464329,
+    2464694, 2465060, 2465425, 2465790, 2466155, 2466521, 2466886, 2467251,
+    2467616, 2467982, 2468347, 2468712, 2469077, 2469443, 2469808, 2470173,
+    2470538, 2470904, 2471269, 2471634, 2471999, 2472365, 2472730, 2473095,
+    2473460, 2473826, 2474191, 2474556, 2474921, 2475287, 2475652, 2476017,
+    2476382, 2476748, 2477113, 2477478, 2477843, 2478209, 2478574, 2478939,
+    2479304, 2479670, 2480035, 2480400, 2480765, 2481131, 2481496, 2481861,
+    2482226, 2482592, 2482957, 2483322, 2483687, 2484053, 2484418, 2484783,
+    2485148, 2485514, 2485879, 2486244, 2486609, 2486975, 2487340, 2487705,
+    2488070, 2488435, 2488800, 2489165, 2489530, 2489896, 2490261, 2490626,
+    2490991, 2491357, 2491722, 2492087, 2492452, 2492818, 2493183, 2493548,
+    2493913, 2494279, 2494644, 2495009, 2495374, 2495740, 2496105, 2496470,
+    2496835, 2497201, 2497566, 2497931, 2498296, 2498662, 2499027, 2499392,
+    2499757, 2500123, 2500488, 2500853, 2501218, 2501584, 2501949, 2502314,
+    2502679, 2503045, 2503410, 2503775, 2504140, 2504506, 2504871, 2505236,
+    2505601, 2505967, 2506332, 2506697, 2507062, 2507428, 2507793, 2508158,
+    2508523, 2508889, 2509254, 2509619, 2509984, 2510350, 2510715, 2511080,
+    2511445, 2511811, 2512176, 2512541, 2512906, 2513272, 2513637, 2514002,
+    2514367, 2514733, 2515098, 2515463, 2515828, 2516194, 2516559, 2516924,
+    2517289, 2517655, 2518020, 2518385, 2518750, 2519116, 2519481, 2519846,
+    2520211, 2520577, 2520942, 2521307, 2521672, 2522038, 2522403, 2522768,
+    2523133, 2523499, 2523864, 2524229, 2524594, 2524959, 2525324, 2525689,
+    2526054, 2526420, 2526785, 2527150, 2527515, 2527881, 2528246, 2528611,
+    2528976, 2529342, 2529707, 2530072, 2530437, 2530803, 2531168, 2531533,
+    2531898, 2532264, 2532629, 2532994, 2533359, 2533725, 2534090, 2534455,
+    2534820, 2535186, 2535551, 2535916, 2536281, 2536647, 2537012, 2537377,
+    2537742, 2538108, 2538473, 2538838, 2539203, 2539569, 2539934, 2540299,
+    2540664, 2541030, 2541395, 2541760, 2542125, 2542491, 2542856, 2543221,
+    2543586, 2543952, 2544317, 2544682, 2545047, 2545413, 2545778, 2546143,
+    2546508, 2546874, 2547239, 2547604, 2547969, 2548335, 2548700, 2549065,
+    2549430, 2549796, 2550161, 2550526, 2550891, 2551257, 2551622, 2551987,
+    2552352, 2552718, 2553083, 2553448, 2553813, 2554179, 2554544, 2554909,
+    2555274, 2555640, 2556005, 2556370, 2556735, 2557101, 2557466, 2557831,
+    2558196, 2558562, 2558927, 2559292, 2559657, 2560023, 2560388, 2560753,
+    2561118, 2561483, 2561848, 2562213, 2562578, 2562944, 2563309, 2563674,
+    2564039, 2564405, 2564770, 2565135, 2565500, 2565866, 2566231, 2566596,
+    2566961, 2567327, 2567692, 2568057, 2568422, 2568788, 2569153, 2569518,
+    2569883, 2570249, 2570614, 2570979, 2571344, 2571710, 2572075, 2572440,
+    2572805, 2573171, 2573536, 2573901, 2574266, 2574632, 2574997, 2575362,
+    2575727, 2576093, 2576458, 2576823, 2577188, 2577554, 2577919, 2578284,
+    2578649, 2579015, 2579380, 2579745, 2580110, 2580476, 2580841, 2581206,
+    2581571, 2581937, 2582302, 2582667, 2583032, 2583398, 2583763, 2584128,
+    2584493, 2584859, 2585224, 2585589, 2585954, 2586320, 2586685, 2587050,
+    2587415, 2587781, 2588146, 2588511, 2588876, 2589242, 2589607, 2589972,
+    2590337, 2590703, 2591068, 2591433, 2591798, 2592164, 2592529, 2592894,
+    2593259, 2593625, 2593990, 2594355, 2594720, 2595086, 2595451, 2595816,
+    2596181, 2596547, 2596912, 2597277, 2597642,
+};
+static const unsigned char _doy_month[2][366] = {
+  {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 11,
+    11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 12, 12,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    12, 12, 12, 12, 12, 12,
+  },
+  {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11,
+    11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 12,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    12, 12, 12, 12, 12, 12,
+  },
+};
+static const short _cum_days[2][13] = {
+    { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365 },
+    { 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366 },
+};
+
+static timefmt *_iso_format(void);
+
+/*----------------------------------------------------------------------------*/
+/* index into _ystart of the year holding julian, or -1 if outside the table  */
+static inline int _tbl_year(int julian)
+{
+    unsigned int off;
+    int i;
+
+    if ( julian < _ystart[0] || julian >= _ystart[TBL_NYEARS] ) return -1;
+
+    /* off/365.2425 to within a year, then put it right */
+    off = julian - _ystart[0];
+    i = (int)(((unsigned long long)off * 11484) >> 22);
+    if ( i >= TBL_NYEARS ) i = TBL_NYEARS-1;
+    if ( julian < _ystart[i] ) i--;
+    else if ( julian >= _ystart[i+1] ) i++;
+    return i;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************
  *  Convert a true Julian day to a calendar date --- year, month and day.     *
  ******************************************************************************/
-void calendar_date(int julian, int *yyyy, int *mm, int *dd)
+static void _calendar_date_arith(int julian, int *yyyy, int *mm, int *dd)
 {
     int j = julian;
     int y, m, d;
@@ -76,7 +243,7 @@ void calendar_date(int julian, int *yyyy, int *mm, int *dd)
 /******************************************************************************
  *  Convert a calendar date to true Julian day                                *
  ******************************************************************************/
-int julian_day(int y, int m, int d)
+static int _julian_day_arith(int y, int m, int d)
 {
     int ya, c;
 
@@ -94,19 +261,51 @@ int julian_day(int y, int m, int d)
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+/******************************************************************************
+ *  Convert a true Julian day to a calendar date --- year, month and day.     *
+ ******************************************************************************/
+void calendar_date(int julian, int *yyyy, int *mm, int *dd)
+{
+    int i, doy, leap, m;
+
+    if ( (i = _tbl_year(julian)) < 0 ) {
+        _calendar_date_arith(julian, yyyy, mm, dd);
+        return;
+    }
+
+    doy = julian - _ystart[i];
+    leap = _ystart[i+1] - _ystart[i] - 365;
+    m = _doy_month[leap][doy];
+
+    *yyyy = TBL_YEAR0 + i;
+    *mm = m;
+    *dd = doy - _cum_days[leap][m-1] + 1;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ *  Convert a calendar date to true Julian day                                *
+ ******************************************************************************/
+int julian_day(int y, int m, int d)
+{
+    int i = y - TBL_YEAR0;
+
+    if ( i < 0 || i >= TBL_NYEARS || m < 1 || m > 12 )
+        return _julian_day_arith(y, m, d);
+
+    return _ystart[i] + _cum_days[_ystart[i+1] - _ystart[i] - 365][m-1] + d - 1;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 /******************************************************************************
  * Converts a time string to the true Julian day and seconds of that day.     *
  * The format of the time string must be:  YYYY-MM-DD hh:mm:ss .              *
  ******************************************************************************/
 void read_time_string(const char *timestr, int *jul, int *secs)
 {
-    int yy,mm,dd,hh,min,ss,n;
-
-    *jul = 0; *secs = 0;
-    n = sscanf(timestr, "%4d-%2d-%2d %2d:%2d:%2d", &yy, &mm, &dd, &hh, &min, &ss);
-    if ( n > 2 ) *jul = julian_day(yy, mm, dd);
-    if ( n > 4 ) *secs = 3600 * hh + 60 * min;
-    if ( n > 5 ) *secs += ss;
+    read_time_formatted(timestr, _iso_format(), jul, secs);
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
@@ -117,15 +316,7 @@ void read_time_string(const char *timestr, int *jul, int *secs)
  ******************************************************************************/
 void write_time_string(char *timestr, int jul, int secs)
 {
-    int ss,min,hh,dd,mm,yy;
-
-    hh   = secs/3600;
-    min  = (secs-hh*3600)/60;
-    ss   = secs - 3600*hh - 60*min;
-
-    calendar_date(jul,&yy,&mm,&dd);
-
-    sprintf(timestr, "%04d-%02d-%02d %02d:%02d:%02d", yy,mm,dd,hh,min,ss);
+    write_time_formatted(timestr, _iso_format(), jul, secs);
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
@@ -145,63 +336,341 @@ int time_diff(int jul1, int secs1, int jul2, int secs2)
 /******************************************************************************/
 int day_of_year(int jday)
 {
-    int y,m,d;
-    calendar_date(jday,&y,&m,&d);
-    return jday - julian_day(y,1,1);
+    int y,m,d,i;
+
+    if ( (i = _tbl_year(jday)) >= 0 ) return jday - _ystart[i];
+
+    _calendar_date_arith(jday,&y,&m,&d);
+    return jday - _julian_day_arith(y,1,1);
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
 /******************************************************************************
- * Decode a time format string into a timefmt structure.                      *
+ * Other calendars.  The noleap (365_day), all_leap (366_day) and 360_day     *
+ * calendars have years all of one length, so a date is a multiply and a      *
+ * table lookup either way.  Their day numbers are counted so that 2000-01-01 *
+ * is day 2451545 in every calendar, the same as its true Julian day, so the  *
+ * Gregorian calendar needs no special case and present day dates stay close  *
+ * to where they would be.  Any other calendar number is taken as Gregorian.  *
  ******************************************************************************/
-timefmt *decode_time_format(const char *fmt)
+static const int _cal_ylen[N_CALENDARS]  = { 0, 365, 366, 360 };
+static const int _cal_epoch[N_CALENDARS] = { 0, 2451545 - 365*2000,
+                                                2451545 - 366*2000,
+                                                2451545 - 360*2000 };
+
+/* floor division, for days before the epoch */
+static inline int _fdiv(int a, int b)
+{ return ( a < 0 ) ? -((b - 1 - a) / b) : a / b; }
+
+#define FIXED_CAL(cal)   ( (cal) > CAL_GREGORIAN && (cal) < N_CALENDARS )
+/*----------------------------------------------------------------------------*/
+int julian_day_cal(int cal, int y, int m, int d)
+{
+    int dy;
+
+    if ( !FIXED_CAL(cal) ) return julian_day(y, m, d);
+
+    /* bring the month into 1..12 */
+    dy = _fdiv(m - 1, 12);
+    y += dy; m -= 12 * dy;
+
+    if ( cal == CAL_360DAY )
+        return _cal_epoch[cal] + 360 * y + 30 * (m - 1) + d - 1;
+    return _cal_epoch[cal] + _cal_ylen[cal] * y
+                           + _cum_days[cal == CAL_ALL_LEAP][m-1] + d - 1;
+}
+/*----------------------------------------------------------------------------*/
+void calendar_date_cal(int cal, int julian, int *yyyy, int *mm, int *dd)
+{
+    int n, y, doy, leap;
+
+    if ( !FIXED_CAL(cal) ) { calendar_date(julian, yyyy, mm, dd); return; }
+
+    n = julian - _cal_epoch[cal];
+    y = _fdiv(n, _cal_ylen[cal]);
+    doy = n - y * _cal_ylen[cal];
+    *yyyy = y;
+
+    if ( cal == CAL_360DAY ) {
+        *mm = doy / 30 + 1;
+        *dd = doy % 30 + 1;
+        return;
+    }
+    leap = ( cal == CAL_ALL_LEAP );
+    *mm = _doy_month[leap][doy];
+    *dd = doy - _cum_days[leap][*mm-1] + 1;
+}
+/*----------------------------------------------------------------------------*/
+int day_of_year_cal(int cal, int jday)
+{
+    int n;
+
+    if ( !FIXED_CAL(cal) ) return day_of_year(jday);
+
+    n = jday - _cal_epoch[cal];
+    return n - _fdiv(n, _cal_ylen[cal]) * _cal_ylen[cal];
+}
+/*----------------------------------------------------------------------------*/
+/* The calendar for a CF conventions calendar attribute, or -1 if unknown     */
+int calendar_from_name(const char *name)
+{
+    static const struct { const char *name; int cal; } names[] = {
+        { "gregorian", CAL_GREGORIAN }, { "standard", CAL_GREGORIAN },
+        { "proleptic_gregorian", CAL_GREGORIAN },
+        { "noleap", CAL_NOLEAP },       { "365_day", CAL_NOLEAP },
+        { "all_leap", CAL_ALL_LEAP },   { "366_day", CAL_ALL_LEAP },
+        { "360_day", CAL_360DAY },
+    };
+    int i;
+
+    if ( name == NULL ) return -1;
+    for (i = 0; i < (int)(sizeof(names)/sizeof(names[0])); i++)
+        if ( strcasecmp(name, names[i].name) == 0 ) return names[i].cal;
+    return -1;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * 64 bit times, counted in seconds from the start of Julian day 0.  These    *
+ * are exact, compare as plain integers and do not overflow for any date      *
+ * the int Julian day can hold.                                               *
+ ******************************************************************************/
+aed_time_t time_from_jul(int jul, int secs)
+{
+    return (aed_time_t)jul * 86400 + secs;
+}
+/*----------------------------------------------------------------------------*/
+void time_to_jul(aed_time_t t, int *jul, int *secs)
+{
+    aed_time_t j = t / 86400, s = t % 86400;
+
+    if ( s < 0 ) { s += 86400; j--; }
+    *jul = (int)j; *secs = (int)s;
+}
+/*----------------------------------------------------------------------------*/
+aed_time_t time_diff_secs(aed_time_t t1, aed_time_t t2)
+{
+    return t1 - t2;
+}
+/*----------------------------------------------------------------------------*/
+aed_time_t read_time_secs(const char *timestr, timefmt *tf)
+{
+    int jul, secs;
+
+    if ( tf != NULL )
+        read_time_formatted(timestr, tf, &jul, &secs);
+    else
+        read_time_string(timestr, &jul, &secs);
+    return time_from_jul(jul, secs);
+}
+/*----------------------------------------------------------------------------*/
+void write_time_secs(char *timestr, timefmt *tf, aed_time_t t)
+{
+    int jul, secs;
+
+    time_to_jul(t, &jul, &secs);
+    if ( tf != NULL )
+        write_time_formatted(timestr, tf, jul, secs);
+    else
+        write_time_string(timestr, jul, secs);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Time formats are compiled to a short program of timeops : literals and     *
+ * fixed or variable width digit fields, which read_time_formatted and        *
+ * write_time_formatted run directly.  The tokens are                         *
+ *    YYYY  year          YY  two digit year (69-99 -> 19xx, 00-68 -> 20xx)   *
+ *    MM    month         DD  day of month        jjj  day of year (1..366)   *
+ *    hh    hour          mm  minute              ss   second                 *
+ *    f...  fraction of a second; accepted but ignored : a fraction read is   *
+ *          dropped (times are whole seconds) and one written is all zeros    *
+ * A token of a single letter is read and written with as many digits as the  *
+ * value needs.  A blank in the format matches any run of blanks.             *
+ ******************************************************************************/
+#define TOP_LIT     0
+#define TOP_SPACE   1
+#define TOP_YEAR    2
+#define TOP_YEAR2   3
+#define TOP_MONTH   4
+#define TOP_DAY     5
+#define TOP_DOY     6
+#define TOP_HOUR    7
+#define TOP_MIN     8
+#define TOP_SEC     9
+#define TOP_FRAC   10
+#define N_TOP      11
+
+#define HAVE(f)    (1 << (f))
+
+/*----------------------------------------------------------------------------*/
+static void _compile_format(timefmt *tf, const char *fmt, char pad)
 {
-    int l, pos;
-    char *f, *s;
+    int l, pos, op;
+    const char *f;
+    char *s;
     char fmtbuf[80];
-    timefmt tf, *t;
 
-    tf.Ypos = -1; tf.Mpos = -1; tf.Dpos = -1;
-    tf.hpos = -1; tf.mpos = -1; tf.spos = -1;
+    tf->Ypos = -1; tf->Mpos = -1; tf->Dpos = -1;
+    tf->hpos = -1; tf->mpos = -1; tf->spos = -1;
+    tf->Ydig = tf->Mdig = tf->Ddig = tf->hdig = tf->mdig = tf->sdig = 0;
+    tf->nops = 0;
+    tf->cal = CAL_GREGORIAN;
 
-    f = (char*)fmt; s = fmtbuf;
+    f = fmt; s = fmtbuf;
     l = 0; pos = 0;
-    while (*f) {
+    while (*f && tf->nops < MAX_TIME_OPS && s < fmtbuf + sizeof(fmtbuf) - 4) {
         switch (*f) {
             case 'Y' :
             case 'M' :
             case 'D' :
+            case 'j' :
             case 'h' :
             case 'm' :
             case 's' :
+            case 'f' :
                 l = 1;
                 while (f[1] == *f) {
                     f++; l++;
                 }
                 *s++ = '%'; if ( l > 1 ) *s++ = '0' + l; *s++ = 'd';
                 switch (*f) {
-                    case 'Y' : tf.Ypos = pos++; tf.Ydig = l; break;
-                    case 'M' : tf.Mpos = pos++; tf.Mdig = l; break;
-                    case 'D' : tf.Dpos = pos++; tf.Ddig = l; break;
-                    case 'h' : tf.hpos = pos++; tf.hdig = l; break;
-                    case 'm' : tf.mpos = pos++; tf.mdig = l; break;
-                    case 's' : tf.spos = pos++; tf.sdig = l; break;
+                    case 'Y' : tf->Ypos = pos++; tf->Ydig = l;
+                               op = ( l == 2 ) ? TOP_YEAR2 : TOP_YEAR; break;
+                    case 'M' : tf->Mpos = pos++; tf->Mdig = l; op = TOP_MONTH; break;
+                    case 'D' : tf->Dpos = pos++; tf->Ddig = l; op = TOP_DAY; break;
+                    case 'h' : tf->hpos = pos++; tf->hdig = l; op = TOP_HOUR; break;
+                    case 'm' : tf->mpos = pos++; tf->mdig = l; op = TOP_MIN; break;
+                    case 's' : tf->spos = pos++; tf->sdig = l; op = TOP_SEC; break;
+                    case 'j' : pos++; op = TOP_DOY; break;
+                    default  : pos++; op = TOP_FRAC; break;
                 }
+                tf->ops[tf->nops].op = op;
+                tf->ops[tf->nops].width = ( l > 1 || op == TOP_FRAC ) ? l : 0;
+                tf->ops[tf->nops].c = ( op == TOP_YEAR2 || op == TOP_DOY ||
+                                        op == TOP_FRAC ) ? '0' : pad;
+                tf->nops++;
                 break;
             default:
                 *s++ = *f;
+                tf->ops[tf->nops].op = ( *f == ' ' || *f == '\t' ) ? TOP_SPACE : TOP_LIT;
+                tf->ops[tf->nops].width = 1;
+                tf->ops[tf->nops].c = *f;
+                tf->nops++;
                 break;
         }
         f++; *s = 0;
     }
-    tf.fmt = strdup(fmtbuf);
+    tf->fmt = strdup(fmtbuf);
+}
+/*----------------------------------------------------------------------------*/
+/* "YYYY-MM-DD hh:mm:ss" as _compile_format(tf, fmt, '0') builds it, kept     */
+/* constant so read_time_string and write_time_string stay reentrant.         */
+/*----------------------------------------------------------------------------*/
+static const timefmt _iso = {
+    0, 4,  1, 2,  2, 2,  3, 2,  4, 2,  5, 2,
+    "%4d-%2d-%2d %2d:%2d:%2d", 11,
+    { { TOP_YEAR, 4, '0' }, { TOP_LIT, 1, '-' }, { TOP_MONTH, 2, '0' },
+      { TOP_LIT,  1, '-' }, { TOP_DAY, 2, '0' }, { TOP_SPACE, 1, ' ' },
+      { TOP_HOUR, 2, '0' }, { TOP_LIT, 1, ':' }, { TOP_MIN,   2, '0' },
+      { TOP_LIT,  1, ':' }, { TOP_SEC, 2, '0' } },
+    CAL_GREGORIAN
+};
+
+static timefmt *_iso_format(void)
+{
+    /* only ever read, never written through */
+    return (timefmt*)&_iso;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-    t = malloc(sizeof(timefmt));
-    memcpy(t, &tf, sizeof(timefmt));
 
+/******************************************************************************
+ * Decode a time format string into a timefmt structure.                      *
+ ******************************************************************************/
+timefmt *decode_time_format(const char *fmt)
+{
+    timefmt *t = malloc(sizeof(timefmt));
+
+    _compile_format(t, fmt, ' ');
     return t;
 }
+/*----------------------------------------------------------------------------*/
+void free_time_format(timefmt *tf)
+{
+    if ( tf == NULL ) return;
+    free(tf->fmt);
+    free(tf);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Run the format program over a time string, as sscanf would : a blank       *
+ * matches any number of blanks, fields skip leading blanks and may have a    *
+ * sign, and scanning stops at the first thing that does not match.  The      *
+ * fields read are left in v[] and flagged in the returned mask.              *
+ ******************************************************************************/
+static int _scan_time(const timefmt *tf, const char *s, int *v, const char **end)
+{
+    const timeop *op = tf->ops, *e = op + tf->nops;
+    int have = 0, n, neg, w;
+
+    for (; op < e; op++) {
+        if ( op->op == TOP_SPACE ) {
+            while ( *s == ' ' || *s == '\t' ) s++;
+            continue;
+        }
+        if ( op->op == TOP_LIT ) {
+            if ( *s != op->c ) break;
+            s++;
+            continue;
+        }
+
+        while ( *s == ' ' || *s == '\t' ) s++;
+        w = ( op->width > 0 ) ? op->width : 10;
+        neg = FALSE;
+        if ( *s == '-' || *s == '+' ) {
+            if ( w < 2 ) break;
+            neg = ( *s++ == '-' ); w--;
+        }
+        if ( (unsigned)(*s - '0') > 9 ) break;
+        for (n = 0; w > 0 && (unsigned)(*s - '0') <= 9; w--)
+            n = n * 10 + (*s++ - '0');
+        v[(int)op->op] = neg ? -n : n;
+        have |= HAVE(op->op);
+    }
+
+    if ( end != NULL ) *end = s;
+    return have;
+}
+/*----------------------------------------------------------------------------*/
+static int _scan_to_jul(int cal, int have, int *v, int *jul, int *secs)
+{
+    *jul = 0; *secs = 0;
+
+    if ( have & HAVE(TOP_YEAR2) ) {
+        v[TOP_YEAR] = v[TOP_YEAR2] + (( v[TOP_YEAR2] < 69 ) ? 2000 : 1900);
+        have |= HAVE(TOP_YEAR);
+    }
+    if ( !(have & HAVE(TOP_YEAR)) ) return FALSE;
+
+    if ( (have & HAVE(TOP_MONTH)) && (have & HAVE(TOP_DAY)) )
+        *jul = julian_day_cal(cal, v[TOP_YEAR], v[TOP_MONTH], v[TOP_DAY]);
+    else if ( have & HAVE(TOP_DOY) )
+        *jul = julian_day_cal(cal, v[TOP_YEAR], 1, 1) + v[TOP_DOY] - 1;
+    else
+        return FALSE;
+
+    if ( (have & HAVE(TOP_HOUR)) && (have & HAVE(TOP_MIN)) ) {
+        *secs = 3600 * v[TOP_HOUR] + 60 * v[TOP_MIN];
+        if ( have & HAVE(TOP_SEC) ) *secs += v[TOP_SEC];
+    }
+    return TRUE;
+}
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
@@ -211,16 +680,108 @@ timefmt *decode_time_format(const char *fmt)
  ******************************************************************************/
 void read_time_formatted(const char *timestr, timefmt *tf, int *jul, int *secs)
 {
-    int n;
-    int vals[7], *v = &vals[1];
+    int v[N_TOP];
 
-    vals[0] = 0;
-    *jul = 0; *secs = 0;
+    _scan_to_jul(tf->cal, _scan_time(tf, timestr, v, NULL), v, jul, secs);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * TRUE if the whole of timestr is in the format with every field in range.   *
+ * The time of day may be left off, as read_time_formatted takes that as      *
+ * midnight, but if it is given it needs at least the hours and minutes.      *
+ * The date must exist in tf->cal; a negative cal only checks day <= 31.      *
+ ******************************************************************************/
+int check_time_formatted(const char *timestr, timefmt *tf)
+{
+    int v[N_TOP], have, want = 0, tod, i, jul, secs, y, m, d;
+    const char *e;
+
+    for (i = 0; i < tf->nops; i++)
+        if ( tf->ops[i].op > TOP_SPACE ) want |= HAVE(tf->ops[i].op);
+
+    tod = HAVE(TOP_HOUR) | HAVE(TOP_MIN) | HAVE(TOP_SEC) | HAVE(TOP_FRAC);
+
+    have = _scan_time(tf, timestr, v, &e);
+    while ( *e == ' ' || *e == '\t' ) e++;
+    if ( *e != 0 || (have & ~tod) != (want & ~tod) ) return FALSE;
+    if ( (have & tod) && !(have & HAVE(TOP_MIN)) ) return FALSE;
 
-    n = sscanf(timestr, tf->fmt, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]);
-    if ( n > 2 ) *jul = julian_day(v[tf->Ypos], v[tf->Mpos], v[tf->Dpos]);
-    if ( n > 4 ) *secs = 3600 * v[tf->hpos] + 60 * v[tf->mpos];
-    if ( n > 5 ) *secs += v[tf->spos];
+    if ( (have & HAVE(TOP_MONTH)) && (v[TOP_MONTH] < 1 || v[TOP_MONTH] > 12) ) return FALSE;
+    if ( (have & HAVE(TOP_DOY)) && (v[TOP_DOY] < 1 || v[TOP_DOY] > 366) ) return FALSE;
+    if ( (have & HAVE(TOP_HOUR)) && (v[TOP_HOUR] < 0 || v[TOP_HOUR] > 24) ) return FALSE;
+    if ( (have & HAVE(TOP_MIN)) && (v[TOP_MIN] < 0 || v[TOP_MIN] > 59) ) return FALSE;
+    if ( (have & HAVE(TOP_SEC)) && (v[TOP_SEC] < 0 || v[TOP_SEC] > 60) ) return FALSE;
+
+    if ( (have & HAVE(TOP_DAY)) && (v[TOP_DAY] < 1 || v[TOP_DAY] > 31) ) return FALSE;
+
+    if ( !_scan_to_jul(tf->cal, have, v, &jul, &secs) ) return FALSE;
+    if ( (have & HAVE(TOP_DAY)) && tf->cal >= 0 ) {
+        /* the date must come back the same, so no 31st of June */
+        calendar_date_cal(tf->cal, jul, &y, &m, &d);
+        if ( d != v[TOP_DAY] || m != v[TOP_MONTH] ) return FALSE;
+    }
+    return TRUE;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Work out the layout of a set of sample time strings.  The layouts are      *
+ * tried in order and the first that every sample fits is returned, so an     *
+ * ambiguous date such as 01/02/2020 is taken as day first.  Returns NULL if  *
+ * none fits.                                                                 *
+ ******************************************************************************/
+static const char *_layouts[] = {
+    "YYYY-MM-DD hh:mm:ss", "YYYY-MM-DD hh:mm", "YYYY-MM-DD",
+    "YYYY-MM-DDThh:mm:ss", "YYYY-MM-DDThh:mm",
+    "YYYY/MM/DD hh:mm:ss", "YYYY/MM/DD hh:mm", "YYYY/MM/DD",
+    "DD/MM/YYYY hh:mm:ss", "DD/MM/YYYY hh:mm", "DD/MM/YYYY",
+    "MM/DD/YYYY hh:mm:ss", "MM/DD/YYYY hh:mm", "MM/DD/YYYY",
+    "DD-MM-YYYY hh:mm:ss", "DD-MM-YYYY hh:mm", "DD-MM-YYYY",
+    "DD.MM.YYYY hh:mm:ss", "DD.MM.YYYY hh:mm", "DD.MM.YYYY",
+    NULL
+};
+
+timefmt *guess_time_format(int n, const char **samples)
+{
+    timefmt tf;
+    int i, k;
+
+    if ( n <= 0 ) return NULL;
+
+    for (i = 0; _layouts[i] != NULL; i++) {
+        _compile_format(&tf, _layouts[i], ' ');
+        free(tf.fmt);
+        tf.cal = -1;        /* the samples may be in any calendar */
+        for (k = 0; k < n; k++)
+            if ( !check_time_formatted(samples[k], &tf) ) break;
+        if ( k == n ) return decode_time_format(_layouts[i]);
+    }
+    return NULL;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Write val right aligned in a field of w characters padded with pad, or in  *
+ * as many as it needs if that is more.                                       *
+ ******************************************************************************/
+static char *_put_int(char *s, int val, int w, char pad)
+{
+    char tmp[12], *t = tmp;
+    unsigned int u = ( val < 0 ) ? -(unsigned int)val : (unsigned int)val;
+    int n;
+
+    do { *t++ = '0' + u % 10; u /= 10; } while (u);
+    if ( val < 0 ) {
+        if ( pad == '0' ) { *s++ = '-'; w--; }
+        else *t++ = '-';
+    }
+    for (n = t - tmp; n < w; n++) *s++ = pad;
+    while ( t > tmp ) *s++ = *--t;
+    return s;
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
@@ -231,18 +792,565 @@ void read_time_formatted(const char *timestr, timefmt *tf, int *jul, int *secs)
  ******************************************************************************/
 void write_time_formatted(char *timestr, timefmt *tf, int jul, int secs)
 {
-    int ss,min,hh,dd,mm,yy;
-    int vals[7], *v = &vals[1];
+    const timeop *op = tf->ops, *e = op + tf->nops;
+    int v[N_TOP], n;
+    char *s = timestr;
+
+    v[TOP_HOUR] = secs/3600;
+    v[TOP_MIN]  = (secs-v[TOP_HOUR]*3600)/60;
+    v[TOP_SEC]  = secs - 3600*v[TOP_HOUR] - 60*v[TOP_MIN];
+
+    calendar_date_cal(tf->cal, jul, &v[TOP_YEAR], &v[TOP_MONTH], &v[TOP_DAY]);
+    v[TOP_YEAR2] = v[TOP_YEAR] % 100;
+    if ( v[TOP_YEAR2] < 0 ) v[TOP_YEAR2] += 100;
+
+    for (; op < e; op++) {
+        switch (op->op) {
+            case TOP_LIT :
+            case TOP_SPACE :
+                *s++ = op->c;
+                break;
+            case TOP_DOY :
+                s = _put_int(s, day_of_year_cal(tf->cal, jul) + 1, op->width, op->c);
+                break;
+            case TOP_FRAC :
+                for (n = 0; n < op->width; n++) *s++ = '0';
+                break;
+            default :
+                s = _put_int(s, v[(int)op->op], op->width, op->c);
+                break;
+        }
+    }
+    *s = 0;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Work out where each time of day field lands in the rendered string.  This  *
+ * is only possible up to the first field of variable width, and only while   *
+ * the string has its expected length.  Fields not in the format are marked   *
+ * -2 as they never need patching.                                            *
+ ******************************************************************************/
+static void _field_offsets(timecache *tc)
+{
+    const timeop *op, *e;
+    int off = 0;
+
+    tc->hoff = tc->moff = tc->soff = -2;
+    tc->hwid = tc->mwid = tc->swid = 0;
+    tc->pad = ' ';
+
+    if ( tc->tf == NULL ) {
+        /* YYYY-MM-DD hh:mm:ss */
+        tc->hoff = 11; tc->moff = 14; tc->soff = 17;
+        tc->hwid = tc->mwid = tc->swid = 2;
+        tc->pad = '0';
+        tc->len = 19;
+        return;
+    }
+
+    for (op = tc->tf->ops, e = op + tc->tf->nops; op < e; op++) {
+        if ( op->op != TOP_LIT && op->op != TOP_SPACE && op->width < 2 ) {
+            /* variable width from here on */
+            if ( tc->hoff == -2 && tc->tf->hpos >= 0 ) tc->hoff = -1;
+            if ( tc->moff == -2 && tc->tf->mpos >= 0 ) tc->moff = -1;
+            if ( tc->soff == -2 && tc->tf->spos >= 0 ) tc->soff = -1;
+            tc->len = -1;
+            return;
+        }
+        switch (op->op) {
+            case TOP_HOUR : tc->hoff = off; tc->hwid = op->width; tc->pad = op->c; break;
+            case TOP_MIN  : tc->moff = off; tc->mwid = op->width; tc->pad = op->c; break;
+            case TOP_SEC  : tc->soff = off; tc->swid = op->width; tc->pad = op->c; break;
+        }
+        off += op->width;
+    }
+    tc->len = off;
+}
+/*----------------------------------------------------------------------------*/
+static int _patch(char *s, int off, int wid, char pad, int val)
+{
+    int i;
+
+    if ( off == -2 ) return TRUE;   /* not shown in this format */
+    if ( off < 0 || wid < 2 || val < 0 || val >= 100 ) return FALSE;
+
+    s += off;
+    for (i = 0; i < wid-2; i++) s[i] = pad;
+    s[wid-2] = ( val < 10 ) ? pad : '0' + val / 10;
+    s[wid-1] = '0' + val % 10;
+    return TRUE;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Set up a time cache for rendering a sequence of times, either in the       *
+ * layout of write_time_string (tf == NULL) or in the given format.           *
+ ******************************************************************************/
+void init_time_cache(timecache *tc, timefmt *tf)
+{
+    tc->tf = tf;
+    tc->valid = FALSE;
+    tc->str[0] = 0;
+    _field_offsets(tc);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Like write_time_string/write_time_formatted, but remembers the last string *
+ * rendered.  While the day stays the same only the time of day digits that   *
+ * changed are rewritten; the calendar date is recomputed only when the day   *
+ * rolls over.  The result is left in tc->str and copied to timestr unless    *
+ * that is NULL.                                                              *
+ ******************************************************************************/
+void write_time_cached(char *timestr, timecache *tc, int jul, int secs)
+{
+    int hh, mi, ss, ok = FALSE;
+
+    if ( tc->valid && jul == tc->jul ) {
+        if ( secs == tc->secs ) ok = TRUE;
+        else {
+            hh = secs/3600;
+            mi = (secs-hh*3600)/60;
+            ss = secs - 3600*hh - 60*mi;
+
+            ok = TRUE;
+            if ( hh != tc->hh ) ok = ok && _patch(tc->str, tc->hoff, tc->hwid, tc->pad, hh);
+            if ( mi != tc->mi ) ok = ok && _patch(tc->str, tc->moff, tc->mwid, tc->pad, mi);
+            if ( ss != tc->ss ) ok = ok && _patch(tc->str, tc->soff, tc->swid, tc->pad, ss);
+            if ( ok ) { tc->hh = hh; tc->mi = mi; tc->ss = ss; tc->secs = secs; }
+        }
+    }
+
+    if ( !ok ) {
+        if ( tc->tf == NULL )
+            write_time_string(tc->str, jul, secs);
+        else
+            write_time_formatted(tc->str, tc->tf, jul, secs);
+
+        tc->hh = secs/3600;
+        tc->mi = (secs-tc->hh*3600)/60;
+        tc->ss = secs - 3600*tc->hh - 60*tc->mi;
+        tc->jul = jul; tc->secs = secs;
+        /* a field outgrew its width, so the offsets cannot be trusted */
+        tc->valid = ( tc->len < 0 || (int)strlen(tc->str) == tc->len );
+    }
+
+    if ( timestr != NULL ) strcpy(timestr, tc->str);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Bulk conversions.                                                          *
+ *                                                                            *
+ * These give exactly what calendar_date, julian_day and day_of_year give for *
+ * each element, but replace the integer divisions by multiply and shift.     *
+ * Within the ranges below every division is exact, and on x86 the work is    *
+ * done 8 (AVX2) or 4 (SSE4.1) at a time, chosen when first called.  Values   *
+ * outside the ranges go through the scalar routines.                         *
+ ******************************************************************************/
+#define VJUL_MIN   1721426                 /* 0001-01-01 */
+#define VJUL_MAX   (1721119 + (1 << 28) - 1)
+#define VYEAR_MIN  1
+#define VYEAR_MAX  1000000
+
+/* x / d for the ranges of x met in the fast paths, verified exhaustively */
+#define M100       42949673u
+#define M146097    963315389u
+#define M1461      2939745u
+#define M153       28071682u
+#define M5         858993460u
+#define DIV100(x)    ((uint32_t)(((uint64_t)(x) * M100) >> 32))
+#define DIV146097(x) ((uint32_t)(((uint64_t)(x) * M146097) >> 47))
+#define DIV1461(x)   ((uint32_t)(((uint64_t)(x) * M1461) >> 32))
+#define DIV153(x)    ((uint32_t)(((uint64_t)(x) * M153) >> 32))
+#define DIV5(x)      ((uint32_t)(((uint64_t)(x) * M5) >> 32))
+
+/*----------------------------------------------------------------------------*/
+static void _calendar_date_1(int julian, int *yyyy, int *mm, int *dd)
+{
+    uint32_t j, y, m, d, t;
+
+    if ( julian < VJUL_MIN || julian > VJUL_MAX ) {
+        calendar_date(julian, yyyy, mm, dd);
+        return;
+    }
+
+    j = 4 * (uint32_t)(julian - 1721119) - 1;
+    y = DIV146097(j);
+    d = (j - 146097 * y) >> 2;
+    j = 4 * d + 3;
+    t = DIV1461(j);
+    d = (j - 1461 * t + 4) >> 2;
+    j = 5 * d - 3;
+    m = DIV153(j);
+    d = DIV5(j - 153 * m + 5);
+    y = 100 * y + t;
+
+    if (m < 10) m += 3;
+    else { m -= 9; y++; }
+
+    *yyyy = y; *mm = m; *dd = d;
+}
+/*----------------------------------------------------------------------------*/
+static int _julian_day_1(int y, int m, int d)
+{
+    uint32_t c, ya;
+
+    if ( y < VYEAR_MIN || y > VYEAR_MAX || m < 1 || m > 12 )
+        return julian_day(y, m, d);
+
+    if (m > 2) m -= 3;
+    else { m += 9; y--; }
+
+    c = DIV100(y);
+    ya = y - 100 * c;
+    return ((146097 * c) >> 2) + ((1461 * ya) >> 2) + DIV5(153 * m + 2) + d + 1721119;
+}
+/*----------------------------------------------------------------------------*/
+static int _day_of_year_1(int jday)
+{
+    int y, m, d;
+
+    if ( jday < VJUL_MIN || jday > VJUL_MAX ) return day_of_year(jday);
+
+    _calendar_date_1(jday, &y, &m, &d);
+    return jday - _julian_day_1(y, 1, 1);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+#if ( defined(__x86_64__) || defined(__i386__) ) && defined(__GNUC__)
+#define AED_X86_SIMD 1
+#include <immintrin.h>
+
+/******************************************************************************
+ * AVX2 versions, 8 values at a time.                                         *
+ ******************************************************************************/
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i _mulhi8(__m256i a, uint32_t m)
+{
+    __m256i mm = _mm256_set1_epi32(m);
+    __m256i ev = _mm256_srli_epi64(_mm256_mul_epu32(a, mm), 32);
+    __m256i od = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), mm);
+    return _mm256_blend_epi32(ev, od, 0xAA);
+}
+/*----------------------------------------------------------------------------*/
+AVX2 static inline int _in_range8(__m256i v, int lo, int hi)
+{
+    __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi32(v, _mm256_set1_epi32(lo-1)),
+                                  _mm256_cmpgt_epi32(_mm256_set1_epi32(hi+1), v));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(ok)) == 0xFF;
+}
+/*----------------------------------------------------------------------------*/
+#define MUL8(a, k)  _mm256_mullo_epi32(a, _mm256_set1_epi32(k))
+#define ADD8(a, k)  _mm256_add_epi32(a, _mm256_set1_epi32(k))
+
+AVX2 static inline void _calendar8(__m256i jul, __m256i *yy, __m256i *mm, __m256i *dd)
+{
+    __m256i j, y, m, d, t, lt10;
+
+    j = ADD8(_mm256_slli_epi32(ADD8(jul, -1721119), 2), -1);
+    y = _mm256_srli_epi32(_mulhi8(j, M146097), 15);
+    d = _mm256_srli_epi32(_mm256_sub_epi32(j, MUL8(y, 146097)), 2);
+    j = ADD8(_mm256_slli_epi32(d, 2), 3);
+    t = _mulhi8(j, M1461);
+    d = _mm256_srli_epi32(ADD8(_mm256_sub_epi32(j, MUL8(t, 1461)), 4), 2);
+    j = ADD8(MUL8(d, 5), -3);
+    m = _mulhi8(j, M153);
+    d = _mulhi8(ADD8(_mm256_sub_epi32(j, MUL8(m, 153)), 5), M5);
+    y = _mm256_add_epi32(MUL8(y, 100), t);
+
+    lt10 = _mm256_cmpgt_epi32(_mm256_set1_epi32(10), m);
+    *mm = _mm256_blendv_epi8(ADD8(m, -9), ADD8(m, 3), lt10);
+    *yy = _mm256_sub_epi32(y, _mm256_andnot_si256(lt10, _mm256_set1_epi32(-1)));
+    *dd = d;
+}
+/*----------------------------------------------------------------------------*/
+AVX2 static inline __m256i _julian8(__m256i y, __m256i m, __m256i d)
+{
+    __m256i gt2, c, ya;
+
+    gt2 = _mm256_cmpgt_epi32(m, _mm256_set1_epi32(2));
+    m = _mm256_blendv_epi8(ADD8(m, 9), ADD8(m, -3), gt2);
+    y = _mm256_add_epi32(y, _mm256_andnot_si256(gt2, _mm256_set1_epi32(-1)));
+
+    c = _mulhi8(y, M100);
+    ya = _mm256_sub_epi32(y, MUL8(c, 100));
+    return ADD8(_mm256_add_epi32(
+               _mm256_add_epi32(_mm256_srli_epi32(MUL8(c, 146097), 2),
+                                _mm256_srli_epi32(MUL8(ya, 1461), 2)),
+               _mm256_add_epi32(_mulhi8(ADD8(MUL8(m, 153), 2), M5), d)), 1721119);
+}
+/*----------------------------------------------------------------------------*/
+AVX2 static int _calendar_date_avx2(int n, const int *jul, int *yy, int *mm, int *dd)
+{
+    __m256i j, y, m, d;
+    int i, k;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        j = _mm256_loadu_si256((const __m256i*)(jul + i));
+        if ( !_in_range8(j, VJUL_MIN, VJUL_MAX) ) {
+            for (k = i; k < i + 8; k++) _calendar_date_1(jul[k], &yy[k], &mm[k], &dd[k]);
+            continue;
+        }
+        _calendar8(j, &y, &m, &d);
+        _mm256_storeu_si256((__m256i*)(yy + i), y);
+        _mm256_storeu_si256((__m256i*)(mm + i), m);
+        _mm256_storeu_si256((__m256i*)(dd + i), d);
+    }
+    return i;
+}
+/*----------------------------------------------------------------------------*/
+AVX2 static int _julian_day_avx2(int n, const int *yy, const int *mm, const int *dd, int *jul)
+{
+    __m256i y, m;
+    int i, k;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        y = _mm256_loadu_si256((const __m256i*)(yy + i));
+        m = _mm256_loadu_si256((const __m256i*)(mm + i));
+        if ( !_in_range8(y, VYEAR_MIN, VYEAR_MAX) || !_in_range8(m, 1, 12) ) {
+            for (k = i; k < i + 8; k++) jul[k] = _julian_day_1(yy[k], mm[k], dd[k]);
+            continue;
+        }
+        _mm256_storeu_si256((__m256i*)(jul + i),
+                 _julian8(y, m, _mm256_loadu_si256((const __m256i*)(dd + i))));
+    }
+    return i;
+}
+/*----------------------------------------------------------------------------*/
+AVX2 static int _day_of_year_avx2(int n, const int *jul, int *doy)
+{
+    __m256i j, y, m, d;
+    int i, k;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        j = _mm256_loadu_si256((const __m256i*)(jul + i));
+        if ( !_in_range8(j, VJUL_MIN, VJUL_MAX) ) {
+            for (k = i; k < i + 8; k++) doy[k] = _day_of_year_1(jul[k]);
+            continue;
+        }
+        _calendar8(j, &y, &m, &d);
+        d = _julian8(y, _mm256_set1_epi32(1), _mm256_set1_epi32(1));
+        _mm256_storeu_si256((__m256i*)(doy + i), _mm256_sub_epi32(j, d));
+    }
+    return i;
+}
+#undef MUL8
+#undef ADD8
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * SSE4.1 versions, 4 values at a time.                                       *
+ ******************************************************************************/
+#define SSE41 __attribute__((target("sse4.1")))
+
+SSE41 static inline __m128i _mulhi4(__m128i a, uint32_t m)
+{
+    __m128i mm = _mm_set1_epi32(m);
+    __m128i ev = _mm_srli_epi64(_mm_mul_epu32(a, mm), 32);
+    __m128i od = _mm_mul_epu32(_mm_srli_epi64(a, 32), mm);
+    return _mm_blend_epi16(ev, od, 0xCC);
+}
+/*----------------------------------------------------------------------------*/
+SSE41 static inline int _in_range4(__m128i v, int lo, int hi)
+{
+    __m128i ok = _mm_and_si128(_mm_cmpgt_epi32(v, _mm_set1_epi32(lo-1)),
+                               _mm_cmplt_epi32(v, _mm_set1_epi32(hi+1)));
+    return _mm_movemask_ps(_mm_castsi128_ps(ok)) == 0xF;
+}
+/*----------------------------------------------------------------------------*/
+#define MUL4(a, k)  _mm_mullo_epi32(a, _mm_set1_epi32(k))
+#define ADD4(a, k)  _mm_add_epi32(a, _mm_set1_epi32(k))
+
+SSE41 static inline void _calendar4(__m128i jul, __m128i *yy, __m128i *mm, __m128i *dd)
+{
+    __m128i j, y, m, d, t, lt10;
+
+    j = ADD4(_mm_slli_epi32(ADD4(jul, -1721119), 2), -1);
+    y = _mm_srli_epi32(_mulhi4(j, M146097), 15);
+    d = _mm_srli_epi32(_mm_sub_epi32(j, MUL4(y, 146097)), 2);
+    j = ADD4(_mm_slli_epi32(d, 2), 3);
+    t = _mulhi4(j, M1461);
+    d = _mm_srli_epi32(ADD4(_mm_sub_epi32(j, MUL4(t, 1461)), 4), 2);
+    j = ADD4(MUL4(d, 5), -3);
+    m = _mulhi4(j, M153);
+    d = _mulhi4(ADD4(_mm_sub_epi32(j, MUL4(m, 153)), 5), M5);
+    y = _mm_add_epi32(MUL4(y, 100), t);
+
+    lt10 = _mm_cmplt_epi32(m, _mm_set1_epi32(10));
+    *mm = _mm_blendv_epi8(ADD4(m, -9), ADD4(m, 3), lt10);
+    *yy = _mm_sub_epi32(y, _mm_andnot_si128(lt10, _mm_set1_epi32(-1)));
+    *dd = d;
+}
+/*----------------------------------------------------------------------------*/
+SSE41 static inline __m128i _julian4(__m128i y, __m128i m, __m128i d)
+{
+    __m128i gt2, c, ya;
 
-    hh   = secs/3600;
-    min  = (secs-hh*3600)/60;
-    ss   = secs - 3600*hh - 60*min;
+    gt2 = _mm_cmpgt_epi32(m, _mm_set1_epi32(2));
+    m = _mm_blendv_epi8(ADD4(m, 9), ADD4(m, -3), gt2);
+    y = _mm_add_epi32(y, _mm_andnot_si128(gt2, _mm_set1_epi32(-1)));
 
-    calendar_date(jul,&yy,&mm,&dd);
+    c = _mulhi4(y, M100);
+    ya = _mm_sub_epi32(y, MUL4(c, 100));
+    return ADD4(_mm_add_epi32(
+               _mm_add_epi32(_mm_srli_epi32(MUL4(c, 146097), 2),
+                             _mm_srli_epi32(MUL4(ya, 1461), 2)),
+               _mm_add_epi32(_mulhi4(ADD4(MUL4(m, 153), 2), M5), d)), 1721119);
+}
+/*----------------------------------------------------------------------------*/
+SSE41 static int _calendar_date_sse41(int n, const int *jul, int *yy, int *mm, int *dd)
+{
+    __m128i j, y, m, d;
+    int i, k;
 
-    v[tf->spos] = ss; v[tf->mpos] = min; v[tf->hpos] = hh;
-    v[tf->Dpos] = dd; v[tf->Mpos] = mm;  v[tf->Ypos] = yy;
+    for (i = 0; i + 4 <= n; i += 4) {
+        j = _mm_loadu_si128((const __m128i*)(jul + i));
+        if ( !_in_range4(j, VJUL_MIN, VJUL_MAX) ) {
+            for (k = i; k < i + 4; k++) _calendar_date_1(jul[k], &yy[k], &mm[k], &dd[k]);
+            continue;
+        }
+        _calendar4(j, &y, &m, &d);
+        _mm_storeu_si128((__m128i*)(yy + i), y);
+        _mm_storeu_si128((__m128i*)(mm + i), m);
+        _mm_storeu_si128((__m128i*)(dd + i), d);
+    }
+    return i;
+}
+/*----------------------------------------------------------------------------*/
+SSE41 static int _julian_day_sse41(int n, const int *yy, const int *mm, const int *dd, int *jul)
+{
+    __m128i y, m;
+    int i, k;
 
-    sprintf(timestr, tf->fmt, v[0], v[1], v[2], v[3], v[4], v[5]);
+    for (i = 0; i + 4 <= n; i += 4) {
+        y = _mm_loadu_si128((const __m128i*)(yy + i));
+        m = _mm_loadu_si128((const __m128i*)(mm + i));
+        if ( !_in_range4(y, VYEAR_MIN, VYEAR_MAX) || !_in_range4(m, 1, 12) ) {
+            for (k = i; k < i + 4; k++) jul[k] = _julian_day_1(yy[k], mm[k], dd[k]);
+            continue;
+        }
+        _mm_storeu_si128((__m128i*)(jul + i),
+                 _julian4(y, m, _mm_loadu_si128((const __m128i*)(dd + i))));
+    }
+    return i;
 }
+/*----------------------------------------------------------------------------*/
+SSE41 static int _day_of_year_sse41(int n, const int *jul, int *doy)
+{
+    __m128i j, y, m, d;
+    int i, k;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        j = _mm_loadu_si128((const __m128i*)(jul + i));
+        if ( !_in_range4(j, VJUL_MIN, VJUL_MAX) ) {
+            for (k = i; k < i + 4; k++) doy[k] = _day_of_year_1(jul[k]);
+            continue;
+        }
+        _calendar4(j, &y, &m, &d);
+        d = _julian4(y, _mm_set1_epi32(1), _mm_set1_epi32(1));
+        _mm_storeu_si128((__m128i*)(doy + i), _mm_sub_epi32(j, d));
+    }
+    return i;
+}
+#undef MUL4
+#undef ADD4
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * 0 for plain code, 1 for SSE4.1, 2 for AVX2                                 *
+ ******************************************************************************/
+static int _simd = -1;
+static int simd_level(void)
+{
+    if ( _simd < 0 ) {
+        __builtin_cpu_init();
+        if ( __builtin_cpu_supports("avx2") ) _simd = 2;
+        else if ( __builtin_cpu_supports("sse4.1") ) _simd = 1;
+        else _simd = 0;
+    }
+    return _simd;
+}
+#endif
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Convert n true Julian days to calendar dates.                              *
+ ******************************************************************************/
+void calendar_date_v(int n, const int *julian, int *yyyy, int *mm, int *dd)
+{
+    int i = 0;
+
+#if AED_X86_SIMD
+    switch ( simd_level() ) {
+        case 2 : i = _calendar_date_avx2(n, julian, yyyy, mm, dd); break;
+        case 1 : i = _calendar_date_sse41(n, julian, yyyy, mm, dd); break;
+    }
+#endif
+    for (; i < n; i++) _calendar_date_1(julian[i], &yyyy[i], &mm[i], &dd[i]);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Convert n calendar dates to true Julian days.                              *
+ ******************************************************************************/
+void julian_day_v(int n, const int *y, const int *m, const int *d, int *julian)
+{
+    int i = 0;
+
+#if AED_X86_SIMD
+    switch ( simd_level() ) {
+        case 2 : i = _julian_day_avx2(n, y, m, d, julian); break;
+        case 1 : i = _julian_day_sse41(n, y, m, d, julian); break;
+    }
+#endif
+    for (; i < n; i++) julian[i] = _julian_day_1(y[i], m[i], d[i]);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Day of year (counting from 0) for each of n true Julian days.              *
+ ******************************************************************************/
+void day_of_year_v(int n, const int *jday, int *doy)
+{
+    int i = 0;
+
+#if AED_X86_SIMD
+    switch ( simd_level() ) {
+        case 2 : i = _day_of_year_avx2(n, jday, doy); break;
+        case 1 : i = _day_of_year_sse41(n, jday, doy); break;
+    }
+#endif
+    for (; i < n; i++) doy[i] = _day_of_year_1(jday[i]);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Fortran entry points                                                       *
+ ******************************************************************************/
+void calendar_date_v_(int *n, const int *julian, int *yyyy, int *mm, int *dd)
+{ calendar_date_v(*n, julian, yyyy, mm, dd); }
+void julian_day_v_(int *n, const int *y, const int *m, const int *d, int *julian)
+{ julian_day_v(*n, y, m, d, julian); }
+void day_of_year_v_(int *n, const int *jday, int *doy)
+{ day_of_year_v(*n, jday, doy); }
+void calendar_date_cal_(int *cal, int *julian, int *yyyy, int *mm, int *dd)
+{ calendar_date_cal(*cal, *julian, yyyy, mm, dd); }
+int julian_day_cal_(int *cal, int *y, int *m, int *d)
+{ return julian_day_cal(*cal, *y, *m, *d); }
+int day_of_year_cal_(int *cal, int *jday)
+{ return day_of_year_cal(*cal, *jday); }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
@@ -30,6 +30,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#else
+#include <windows.h>
+#endif
 
 #include "namelist.h"
 
@@ -41,6 +54,41 @@
 #ifdef _WIN32
   #define strcasecmp stricmp
   #define strncasecmp _strnicmp
+  #define realpath(n, r) _fullpath(r, n, _MAX_PATH)
+#endif
+
+/******************************************************************************
+ * Several threads may open and read namelists at once.  Each namelist has a  *
+ * lock, taken for anything that changes it : parsing a section, taking room  *
+ * from its arena, converting or viewing values.  Reading what is already     *
+ * there takes no lock; whatever a reader may find (a parsed section, a slot  *
+ * of the entry hash, the hash itself, a view) is filled in first and only    *
+ * then published, by a release store that the reader loads with acquire.     *
+ * The list of namelists and the include cache each have a lock of their own. *
+ ******************************************************************************/
+#ifdef _WIN32
+  typedef SRWLOCK NML_Lock;
+  #define NML_LOCK_INIT        SRWLOCK_INIT
+  #define nml_lock_init(l)     InitializeSRWLock(l)
+  #define nml_lock(l)          AcquireSRWLockExclusive(l)
+  #define nml_unlock(l)        ReleaseSRWLockExclusive(l)
+
+  /* aligned words are atomic on x86 and x64, the barriers give the order */
+  static int load_int(void *p) { int v = *(volatile int*)p; MemoryBarrier(); return v; }
+  static void store_int(void *p, int v) { MemoryBarrier(); *(volatile int*)p = v; }
+  static void *load_ptr(void *p) { void *v = *(void *volatile*)p; MemoryBarrier(); return v; }
+  static void store_ptr(void *p, void *v) { MemoryBarrier(); *(void *volatile*)p = v; }
+#else
+  typedef pthread_mutex_t NML_Lock;
+  #define NML_LOCK_INIT        PTHREAD_MUTEX_INITIALIZER
+  #define nml_lock_init(l)     pthread_mutex_init(l, NULL)
+  #define nml_lock(l)          pthread_mutex_lock(l)
+  #define nml_unlock(l)        pthread_mutex_unlock(l)
+
+  #define load_int(p)          __atomic_load_n((int*)(p), __ATOMIC_ACQUIRE)
+  #define store_int(p, v)      __atomic_store_n((int*)(p), (v), __ATOMIC_RELEASE)
+  #define load_ptr(p)          __atomic_load_n((void**)(p), __ATOMIC_ACQUIRE)
+  #define store_ptr(p, v)      __atomic_store_n((void**)(p), (void*)(v), __ATOMIC_RELEASE)
 #endif
 
 typedef union _nml_value {
@@ -53,110 +101,276 @@ typedef union _nml_value {
 typedef struct _nml_entry {
     char      *name;
     int        type;
-    int        count;
+    int        count;       /* values, with the repeats written out */
+    int        nval;        /* values held in data */
+    int        size;        /* values there is room for in data */
     NML_Value *data;
+    int       *rep;         /* repeat count of each, NULL if there are none */
+    void      *view;        /* data as ints etc, made when first asked for */
+    struct _nml_entry *reals; /* ints as doubles, made when first asked for */
 } NML_Entry;
 
 typedef struct _nml_sect {
     char *name;
     int   count;
+    int   size;
     NML_Entry *entry;
+    const char *start;      /* the text of the section, parsed when first */
+    const char *end;        /* asked for                                  */
+    const char *fname;
+    int   lineno;
+    int   parsed;
+    int   hashed;           /* its entries are in the entry hash */
+    uint64_t thash;         /* of its text, 0 if it has none */
+    uint64_t tlen;          /* and the length of that text */
+    int   gen;              /* the generation it last changed in */
+    int   gone;             /* kept, empty, after going from the file */
+    struct _nml_sect *next; /* the next section of the same name */
 } NML_Section;
 
+/* a section or include line found in a file, in the order they come */
+typedef struct _nml_item {
+    const char *name;       /* of a section, nlen long, in the file text */
+    int   nlen;
+    char *iname;            /* of an include file, or NULL */
+    const char *start, *end;
+    uint64_t hash;          /* of the text start..end */
+    int   lineno;
+} NML_Item;
+
+/* an included file in the process wide cache */
+typedef struct _nml_incl {
+    char  *path;            /* canonical */
+    long long mtime, fsize;
+    char  *text;
+    size_t len;
+    NML_Item *item;
+    int    count;
+    int    refs;            /* texts of open namelists using it */
+    int    stale;           /* out of the cache, freed when refs gets to 0 */
+    struct _nml_incl *next;
+} NML_Incl;
+
+/* a file kept in memory while its sections may still be parsed */
+typedef struct _nml_text {
+    char  *text;
+    size_t len;
+    const char *fname;      /* NULL for a snapshot */
+    long long mtime, fsize; /* as it was when read */
+    uint64_t   hash;        /* of the text read, kept for a snapshot source */
+    NML_Incl  *incl;        /* the cache entry holding it, if an include */
+} NML_Text;
+
+/* the arena everything for one namelist is carved from */
+typedef struct _nml_block {
+    struct _nml_block *next;
+    size_t size, used;
+} NML_Block;
+
+/* one slot of the (section, entry) hash index, h is 0 when empty */
+typedef struct _nml_hslot {
+    unsigned int h;
+    NML_Section *sect;
+    NML_Entry   *entry;
+} NML_HSlot;
+
+/* the entry hash, replaced by a bigger one as a whole when it fills */
+typedef struct _nml_htable {
+    unsigned int mask;      /* size - 1, the size is a power of two */
+    unsigned int count;
+    NML_HSlot    slot[1];
+} NML_HTable;
+
+/* what readers look sections and entries up in : a reload builds a new one  */
+/* and swaps it in whole, leaving the old as it was for any still using it   */
+typedef struct _nml_index {
+    NML_HTable  *shash;     /* section names, filled before it is swapped in */
+    NML_HTable  *hash;      /* (section, entry), grown as sections are read */
+} NML_Index;
+
 typedef struct _nml {
     char *fname;
     FILE *file;
     int   count;
     NML_Section *section;
+    int   size;
+    NML_Block   *arena;
+    NML_Text    *text;
+    int   n_text, text_size;
+    NML_Text    *retired;   /* texts read before a reload, kept until closed */
+    int   n_retired, retired_size;
+    NML_Index   *index;
+    int   base;             /* what an overlay is laid over, else -1 */
+    int   overlays;         /* overlays laid over this, -1 once closing */
+    int   watch;            /* seconds between checks, -1 if not watched */
+    int   gen;              /* reloads that changed something */
+    time_t checked;
+    NML_Lock lock;
+    int   next_free;        /* the next closed slot, once this is closed */
 } NML;
 
-#define BUFCHUNK      10240
+/* where the scanner is in the file being read */
+typedef struct _nml_scan {
+    const char *p, *end;
+    const char *fname;
+    int   lineno;
+} NML_Scan;
+
+#define MAX_INCLUDE   10
+#define ARENA_FIRST   65536
+#define ARENA_ALIGN   sizeof(NML_Value)
+
+/* namelists are kept in chunks that never move, so a pointer to one stays  */
+/* good while others are opened                                             */
+#define NML_CHUNK     64
+#define NML_CHUNKS    1024
+#define nml_of(file)  (&nml_dir[(file) / NML_CHUNK][(file) % NML_CHUNK])
 
 /******************************************************************************/
-static int  list_count = 0;
-static NML *file_list = NULL;
-static char buf[BUFCHUNK];
+static NML *nml_dir[NML_CHUNKS];
+static int  list_count = 0;         /* slots ever used */
+static int  free_slot = -1;         /* the last closed */
+static NML_Lock list_lock = NML_LOCK_INIT;
+static NML_Incl *incl_cache = NULL;
+static NML_Lock incl_lock = NML_LOCK_INIT;
 static double zero = 0.;
 #if DEBUG_NML
 static void show_namelist(int file);
 static void show_entry(NML_Entry *ne);
 #endif
-static int lineno = 0;
+static void build_section_hash(NML *fl, NML_Index *ix);
+static void release_incl(NML_Incl *inc);
+static uint64_t hash_text(const char *s, size_t n);
+static int snapshot_name(const char *fname, char *sname, size_t len);
+static int load_snapshot(NML *fl, const char *sname);
 
 /******************************************************************************
- *                                                                            *
+ * Each open namelist owns an arena : a chain of blocks, each twice the size  *
+ * of the one before, that parsing takes memory from and never gives back.    *
+ * Closing the namelist frees the blocks and with them the whole tree.        *
  ******************************************************************************/
-static char *readline(FILE *inf, char *buf)
+static void *nml_alloc(NML *fl, size_t n)
 {
-    char *ln = NULL, *s, term;
-    int size = BUFCHUNK;
-
-    if ( feof(inf) ) {
-        fprintf(stderr, "Early end of file\n");
-        return NULL;
+    NML_Block *b = fl->arena;
+    size_t sz;
+    void *p;
+
+    n = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if ( b == NULL || b->size - b->used < n ) {
+        sz = ( b == NULL ) ? ARENA_FIRST : b->size * 2;
+        while ( sz < n ) sz *= 2;
+        if ( (b = malloc(sizeof(NML_Block) + sz)) == NULL ) {
+            fprintf(stderr, "Out of memory reading namelist \"%s\"\n", fl->fname);
+            exit(1);
+        }
+        b->next = fl->arena; b->size = sz; b->used = 0;
+        fl->arena = b;
     }
+    p = (char*)(b + 1) + b->used;
+    b->used += n;
+    return p;
+}
+/*----------------------------------------------------------------------------*/
+/* as nml_alloc, for a caller that does not already hold the namelist's lock  */
+static void *nml_alloc_locked(NML *fl, size_t n)
+{
+    void *p;
 
-    ln = buf;
+    nml_lock(&fl->lock);
+    p = nml_alloc(fl, n);
+    nml_unlock(&fl->lock);
+    return p;
+}
+/*----------------------------------------------------------------------------*/
+static char *nml_strdup(NML *fl, const char *s)
+{
+    size_t l = strlen(s) + 1;
+    return memcpy(nml_alloc(fl, l), s, l);
+}
+/*----------------------------------------------------------------------------*/
+/* make room for one more of *count items of isz bytes, doubling as needed    */
+static void *nml_grow(NML *fl, void *arr, int count, int *size, size_t isz)
+{
+    void *n;
 
-    do  {
-        ln = buf;
-        ln[0] = 0;
-        if ( feof(inf) || fgets(ln, size, inf) == NULL) return NULL;
+    if ( count < *size ) return arr;
+    *size = ( *size == 0 ) ? 4 : *size * 2;
+    n = nml_alloc(fl, *size * isz);
+    if ( count > 0 ) memcpy(n, arr, count * isz);
+    return n;
+}
+/*----------------------------------------------------------------------------*/
+static void nml_free_arena(NML *fl)
+{
+    NML_Block *b, *n;
 
-        // strip off any LF or CR characters
-        while ( ln[0] != 0 && (ln[strlen(ln)-1] == '\n' || ln[strlen(ln)-1] == '\r' ) )
-            ln[strlen(ln)-1] = 0;
+    for (b = fl->arena; b != NULL; b = n) { n = b->next; free(b); }
+    fl->arena = NULL;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-        if ( !strlen(ln) && feof(inf) ) {
-            return NULL;
-        }
 
-        if ( ln[0] == 0 ) continue; // skip empty lines
+/******************************************************************************
+ * The whole file is read into memory and scanned a line at a time with no    *
+ * further copying : scan_line returns the next line that has anything in it  *
+ * as the range ls..le, with comments and blanks at either end left out.      *
+ * There is no limit on the length of a line.                                 *
+ ******************************************************************************/
+static int scan_line(NML_Scan *sc, const char **ls, const char **le)
+{
+    const char *s, *e, *l;
+    char term;
+
+    while ( sc->p < sc->end ) {
+        l = sc->p;
+        sc->lineno++;
 
-        s = ln;
-        while (*s) {
-            if (*s == '"' || *s == '\'' ) {
+        // find the end of the line, stopping the text at any comment
+        for (s = l, e = NULL; s < sc->end && *s != '\n'; s++) {
+            if ( e != NULL ) continue;
+            if ( *s == '"' || *s == '\'' ) {
                 term = *s++;
-                while (*s && *s != term) s++;
-                if (*s != term) { fprintf(stderr, "Unterminated string\n"); exit(1); }
+                while ( s < sc->end && *s != '\n' && *s != term ) s++;
+                if ( s >= sc->end || *s != term ) {
+                    fprintf(stderr, "Unterminated string in \"%s\" at %d\n", sc->fname, sc->lineno);
+                    exit(1);
+                }
             }
-            if (*s == '\\') s++;
-            else if (*s == '!' || *s == '#') *s = 0;
-            else s++;
+            else if ( *s == '\\' && s+1 < sc->end && s[1] != '\n' ) s++;
+            else if ( *s == '!' || *s == '#' ) e = s;
         }
+        sc->p = ( s < sc->end ) ? s + 1 : s;
+        if ( e == NULL ) e = s;
 
-        s = ln;
-        while (*s && ( *s == ' ' || *s == '\t' ) ) s++;
-        if ( s != ln ) memmove(ln, s, strlen(s)+1);
+        while ( l < e && ( *l == ' ' || *l == '\t' ) ) l++;
+        while ( e > l && ( e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r' ) ) e--;
 
-        s = &ln[strlen(ln)-1];
-        while (s >= ln && ( *s == ' ' || *s == '\t' ) ) *s-- = 0;
+        if ( l < e ) { *ls = l; *le = e; return TRUE; }
     }
-    while (ln[0] == 0);
-
-    lineno++;
-    return buf;
+    return FALSE;
 }
+/*----------------------------------------------------------------------------*/
+#define is_end_line(ls, le)  ( (le) - (ls) == 1 && *(ls) == '/' )
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
 /******************************************************************************
  *                                                                            *
  ******************************************************************************/
-static char *trim_buf_name(char *buf)
+static const char *trim_buf_name(NML_Scan *sc, const char *ls, const char *le, int *nlen)
 {
-    char *e = strchr(buf, '=');
-    char *r = NULL;
+    const char *e = memchr(ls, '=', le - ls);
+    const char *r = NULL;
     if ( e == NULL ) {
-        fprintf(stderr, "syntax error in file \"%s\" at %d\n",buf,lineno);
+        fprintf(stderr, "syntax error in file \"%s\" at %d\n",sc->fname,sc->lineno);
         exit(1);
     }
     r = e;
-    do { *e-- = 0; }
-    while ((*e == ' ' || *e == '\t') && e > buf);
+    while ( e > ls && ( e[-1] == ' ' || e[-1] == '\t' ) ) e--;
+    *nlen = e - ls;
 
     do { r++; }
-    while ((*r == ' ' || *r == '\t') && *r);
+    while ( r < le && (*r == ' ' || *r == '\t') );
 
     return r;
 }
@@ -200,128 +414,190 @@ static int decode_buf(const char *s, double *r, long long int *i, int *b)
 /******************************************************************************
  *                                                                            *
  ******************************************************************************/
-static char *grab_substring(const char *s, int n)
+static char *copy_substring(char *d, const char *s, int n)
 {
-    char *d, *e;
+    char *e = d;
 
-    e = ( d = malloc(n+1) );
-    while ( *s && n-- > 0 ) {
+    while ( n-- > 0 ) {
         if ( *s == '\\' ) { s++; n--; }
         *e++ = *s++;
     }
     *e = 0;
     return d;
 }
+/*----------------------------------------------------------------------------*/
+static char *grab_substring(NML *fl, const char *s, int n)
+{
+    return copy_substring(nml_alloc(fl, n+1), s, n);
+}
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
 /******************************************************************************
- *                                                                            *
+ * Step over the next value in r..e, leaving it in s..s+n and r at the one    *
+ * after.  Returns TRUE if it was a quoted string (quotes not included).      *
+ * A Fortran repeat, as in 500*0.0, gives the count in *rep, otherwise 1.     *
+ * A repeat count below 1 or too big for an int is reported and *rep is 0,    *
+ * for the caller to skip the value.                                          *
+ ******************************************************************************/
+static int next_value(const char **rp, const char *e, const char **s, size_t *n, int *rep)
+{
+    const char *r = *rp, *t;
+    char term;
+    int quoted = FALSE;
+
+    *rep = 1;
+    for (t = r; t < e && *t >= '0' && *t <= '9'; t++) ;
+    if ( t > r && t < e && *t == '*' ) {
+        long l;
+
+        errno = 0;
+        l = strtol(r, NULL, 10);
+        if ( errno == ERANGE || l < 1 || l > INT_MAX ) {
+            fprintf(stderr, "Bad repeat count \"%.*s\"\n", (int)(t - r + 1), r);
+            l = 0;
+        }
+        *rep = l;
+        r = t + 1;
+    }
+
+    *s = r;
+    if (*r == '"' || *r == '\'' ) { // a string
+        term = *r++; (*s)++;
+        while (r < e && *r != term) {
+            if (*r == '\\' ) r++;
+            r++;
+        }
+        if ( r >= e ) { fprintf(stderr, "unmatched '%c'\n", term); exit(1); }
+
+        *n = r++ - *s;
+        quoted = TRUE;
+
+        while (r < e && *r != ',' ) r++;
+    } else {
+        while (r < e && *r != ',' ) r++;
+
+        *n = r - *s;
+        if ( r < e ) r++;
+    }
+
+    while ( r < e && ( *r == ' ' || *r == '\t' ) ) r++; // skip blanks
+    if ( r < e && *r == ',' ) {
+        r++;
+        while ( r < e && ( *r == ' ' || *r == '\t' ) ) r++; // skip blanks
+    }
+    *rp = r;
+    return quoted;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Pull the values out of the range r..e and add them to the entry.           *
+ * Numbers are decoded from a copy on the stack, only strings are kept.       *
  ******************************************************************************/
-static int extract_values(NML_Entry *entry, char *r)
+static void extract_values(NML *fl, NML_Entry *entry, const char *r, const char *e)
 {
-    char *s, *d, term;
+    const char *s;
+    char *d, tmp[128];
     size_t n;
-    int comma = FALSE, type;
+    int type, rep, osize, i, quoted;
     long long int ires = 0;
     int bd = FALSE;
     double rres = 0.;
 
     do  {
-        s = r;
-        if (*r == '"' || *r == '\'' ) { // a string
-            term = *r++; s++;
-            while (*r && *r != term) {
-                if (*r == '\\' ) r++;
-                r++;
-            }
-            if ( *r != term ) { fprintf(stderr, "unmatched '%c'\n", term); exit(1); }
-
-            n = r++ - s;
-
-            d = grab_substring(s, n);
+        quoted = next_value(&r, e, &s, &n, &rep);
+        if ( rep == 0 ) continue;
+        if ( entry->count > INT_MAX - rep ) {
+            fprintf(stderr, "Too many values for %s\n", entry->name);
+            return;
+        }
+        if ( quoted ) {
+            d = grab_substring(fl, s, n);
 
             type = TYPE_STR;
-
-            while (*r && *r != ',' ) r++;
         } else {
-            while (*r && *r != ',' ) r++;
-
-            n = r - s;
-            if ( *r ) r++;
-
-            d = grab_substring(s, n);
+            d = ( n < sizeof(tmp) ) ? copy_substring(tmp, s, n) : grab_substring(fl, s, n);
 
             type = decode_buf(d, &rres, &ires, &bd);
+            if ( type == TYPE_STR && d == tmp ) d = nml_strdup(fl, tmp);
             if ( type == TYPE_INT && entry->type == TYPE_DOUBLE ) {
                 type = entry->type;
                 // rres = ires;
             } else if ( type == TYPE_DOUBLE && entry->type == TYPE_INT ) {
                 // This is a fix if the first item of a list was made an int, but there are reals in the
                 // list meaning the whole list should have been reals.
-                int i;
-                for (i = 0; i < entry->count; i++) {
+                for (i = 0; i < entry->nval; i++) {
                     double tr = entry->data[i].i;
                     entry->data[i].r = tr;
                 }
                 entry->type = TYPE_DOUBLE;
             }
-
-            free(d);
         }
         if ( entry->type == 0 ) entry->type = type;
-        entry->data = realloc(entry->data, sizeof(NML_Value)*(entry->count+1));
-        memset(&entry->data[entry->count], 0, sizeof(NML_Value));
+        osize = entry->size;
+        entry->data = nml_grow(fl, entry->data, entry->nval, &entry->size, sizeof(NML_Value));
+        memset(&entry->data[entry->nval], 0, sizeof(NML_Value));
         switch (type) {
             case TYPE_STR :
-                entry->data[entry->count].s = d;
+                entry->data[entry->nval].s = d;
                 break;
             case TYPE_INT :
-                entry->data[entry->count].i = ires;
+                entry->data[entry->nval].i = ires;
                 break;
             case TYPE_DOUBLE :
-                entry->data[entry->count].r = rres;
+                entry->data[entry->nval].r = rres;
                 break;
             case TYPE_BOOL :
-                entry->data[entry->count].b = bd;
+                entry->data[entry->nval].b = bd;
                 break;
         }
-        entry->count++;
 
-        comma = FALSE;
-        while ( *r && ( *r == ' ' || *r == '\t' ) ) r++; // skip blanks
-        if ( *r == ',' ) {
-            r++;
-            while ( *r && ( *r == ' ' || *r == '\t' ) ) r++; // skip blanks
-            comma = TRUE;
+        // repeats are kept as a count beside the value, made on the first one
+        if ( entry->rep != NULL && entry->size != osize )
+            entry->rep = memcpy(nml_alloc(fl, entry->size * sizeof(int)),
+                                             entry->rep, entry->nval * sizeof(int));
+        if ( rep != 1 && entry->rep == NULL ) {
+            entry->rep = nml_alloc(fl, entry->size * sizeof(int));
+            for (i = 0; i < entry->nval; i++) entry->rep[i] = 1;
         }
-    } while (*r);
-
-    return comma;
+        if ( entry->rep != NULL ) entry->rep[entry->nval] = rep;
+        entry->nval++;
+        entry->count += rep;
+    } while (r < e);
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
 /******************************************************************************
- *                                                                            *
+ * Read an entry starting on the line ls..le and any lines of values that     *
+ * follow it.  On return ls..le is the line after the last of those.          *
  ******************************************************************************/
-static int get_entry(FILE *f, NML_Entry *entry, char *name)
+static int get_entry(NML_Scan *sc, NML *fl, NML_Entry *entry, const char **ls, const char **le)
 {
-    char *r = trim_buf_name(name);
+    int nlen;
+    const char *r = trim_buf_name(sc, *ls, *le, &nlen);
 
-    entry->name = strdup(name);
+    entry->name = grab_substring(fl, *ls, nlen);
     entry->type = 0;
     entry->count = 0;
+    entry->nval = 0;
+    entry->size = 0;
     entry->data = NULL;
+    entry->rep = NULL;
+    entry->view = NULL;
+    entry->reals = NULL;
 
     do  {
-        if (r[0] != 0) extract_values(entry, r);
+        if (r < *le) extract_values(fl, entry, r, *le);
 
-        if ( (r = readline(f, buf) ) ) {
-            if ( strcmp(buf, "/") == 0 ) return 1;
+        if ( scan_line(sc, ls, le) ) {
+            if ( is_end_line(*ls, *le) ) return 1;
         } else return -1;
+        r = *ls;
     }
-    while ( strchr(buf, '=') == NULL );
+    while ( memchr(*ls, '=', *le - *ls) == NULL );
 
     return 0;
 }
@@ -331,20 +607,20 @@ static int get_entry(FILE *f, NML_Entry *entry, char *name)
 /******************************************************************************
  *                                                                            *
  ******************************************************************************/
-static int get_section(FILE *f, NML_Section *section, const char *name)
+static int get_section(NML_Scan *sc, NML *fl, NML_Section *section)
 {
-    section->name = strdup(name);
-    section->entry = NULL;
-    section->count = 0;
+    const char *ls, *le;
 
-    readline(f, buf);
-    if ( strcmp(buf, "/") == 0 ) return 1;
+    if ( !scan_line(sc, &ls, &le) ) return -1;
+    if ( is_end_line(ls, le) ) return 1;
 
     do  {
-        section->entry = realloc(section->entry, sizeof(NML_Entry)*(section->count+1));
-        get_entry(f, &section->entry[section->count++], buf);
+        section->entry = nml_grow(fl, section->entry, section->count,
+                                           &section->size, sizeof(NML_Entry));
+        if ( get_entry(sc, fl, &section->entry[section->count++], &ls, &le) < 0 )
+            return -1;
     }
-    while ( strcmp(buf, "/") != 0 );
+    while ( !is_end_line(ls, le) );
 
     return 0;
 }
@@ -352,109 +628,446 @@ static int get_section(FILE *f, NML_Section *section, const char *name)
 
 
 /******************************************************************************
- *                                                                            *
+ * The file name from an include line, malloced.                              *
  ******************************************************************************/
-static int npush = 0;
-static FILE *fs[10];
-static const char *fn[10];
-
-int push_file(FILE *f, const char *fname)
+static char *get_include_name(const char *ls, const char *le)
 {
-    if ( npush > 9 ) return -1;
-    fs[npush] = f;
-    fn[npush] = fname;
-    npush++;
-    return 0;
+    const char *s = ls, *e;
+
+    while ( s < le && *s != '"' && *s != '\'' ) s++;
+    if ( s >= le ) {
+        fprintf(stderr, "Include file declaration must start with a \" or \'\n");
+        return NULL;
+    }
+    e = ++s;
+    while ( e < le && *e != '"' && *e != '\'' ) e++;
+    if ( e >= le ) {
+        fprintf(stderr, "Include file declaration must end with a \" or \'\n");
+        return NULL;
+    }
+    return copy_substring(malloc(e - s + 1), s, e - s);
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
-int pop_file(FILE **f, const char **fname)
+/******************************************************************************
+ * Read the whole of a file into memory.  It is read rather than mapped as    *
+ * sections are parsed from it long after opening : a mapped file truncated   *
+ * or rewritten in the meantime would fault on the next lookup.               *
+ ******************************************************************************/
+static char *load_file(const char *fname, size_t *len)
 {
-    if ( npush <= 0 ) return -1;
-    npush--;
-    if (npush) free((void*)*fname);
-    *f = fs[npush];
-    *fname = fn[npush];
-    return 0;
+    char *text = NULL;
+    FILE *f;
+    long sz;
+
+    *len = 0;
+    if ( (f = fopen(fname, "rb")) == NULL ) return NULL;
+    fseek(f, 0, SEEK_END);
+    if ( (sz = ftell(f)) < 0 ) sz = 0;
+    fseek(f, 0, SEEK_SET);
+    text = malloc(sz + 1);
+    *len = fread(text, 1, sz, f);
+    fclose(f);
+    return text;
+}
+/*----------------------------------------------------------------------------*/
+/* the modification time of a file, to the nanosecond where that is kept, so */
+/* a file rewritten in the same second as it was read is still seen to change */
+static long long stat_mtime(const struct stat *st)
+{
+#if defined(_WIN32)
+    return st->st_mtime * 1000000000LL;
+#elif defined(__APPLE__)
+    return st->st_mtimespec.tv_sec * 1000000000LL + st->st_mtimespec.tv_nsec;
+#else
+    return st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+#endif
+}
+/*----------------------------------------------------------------------------*/
+static void unload_file(char *text)
+{
+    free(text);
+}
+/*----------------------------------------------------------------------------*/
+static void unload_texts(NML_Text *text, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if ( text[i].incl != NULL )
+            release_incl(text[i].incl);
+        else
+            unload_file(text[i].text);
+    }
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
-int get_new_name(const char *buf, const char **fname)
+/******************************************************************************
+ * Find the sections and include lines of a file.  Each section is only       *
+ * located here; its entries are parsed when it is first asked for, so the    *
+ * text stays in memory until the namelist is closed.  The items found are    *
+ * malloced, as are the names of include files.  Returns 0 or -1 on an error. *
+ ******************************************************************************/
+static int scan_items(const char *text, size_t len, const char *fname, int depth,
+                                                  NML_Item **items, int *count)
+{
+    NML_Scan sc;
+    NML_Item *it;
+    const char *ls, *le;
+    int ret = 0, more, size = 0;
+
+    *items = NULL; *count = 0;
+    sc.p = text; sc.end = text + len;
+    sc.fname = fname; sc.lineno = 0;
+
+    while ( ret == 0 && scan_line(&sc, &ls, &le) ) {
+        if ( *count >= size ) {
+            size = ( size == 0 ) ? 16 : size * 2;
+            *items = realloc(*items, size * sizeof(NML_Item));
+        }
+        it = &(*items)[*count];
+        memset(it, 0, sizeof(NML_Item));
+
+        if ( le - ls > 8 && strncasecmp(ls, "include ", 8) == 0 ) {
+            if ( (it->iname = get_include_name(ls, le)) == NULL ) ret = -1;
+            else (*count)++;
+        } else if ( *ls != '&' ) {
+            fprintf(stderr, "Error in %sfile \"%s\"\n", (depth)?"included ":"", fname);
+            fprintf(stderr, "\"%.*s\"\n", (int)(le - ls), ls);
+            ret = -1;
+        } else {
+            it->name = ls + 1;
+            it->nlen = le - ls - 1;
+            it->start = sc.p;
+            it->lineno = sc.lineno;
+
+            // skip to the line holding just the /
+            while ( (more = scan_line(&sc, &ls, &le)) && !is_end_line(ls, le) ) ;
+            if ( !more ) {
+                fprintf(stderr, "Early end of file \"%s\"\n", fname);
+                ret = -1;
+            }
+            it->end = sc.p;
+            it->hash = hash_text(it->start, it->end - it->start);
+            (*count)++;
+        }
+    }
+    return ret;
+}
+/*----------------------------------------------------------------------------*/
+/* 64 bit FNV-1a of some text, to tell if it has changed                      */
+static uint64_t hash_text(const char *s, size_t n)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    while ( n-- > 0 ) { h ^= (unsigned char)*s++; h *= 1099511628211ULL; }
+    return h;
+}
+/*----------------------------------------------------------------------------*/
+static void free_items(NML_Item *items, int count)
 {
-    char *s = (char*)buf;
-    size_t l = strlen(s);
-    char *tname = malloc((l+1)*sizeof(char));
     int i;
-    while ( *s != '"' && *s != '\'' && *s != 0 ) s++;
-    if (*s == 0 ) {
-        fprintf(stderr, "Include file declaration must start with a \" or \'\n");
-        free(tname); *fname = NULL;
-        return -1;
+
+    for (i = 0; i < count; i++) free(items[i].iname);
+    free(items);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Included files are kept in a cache for the life of the process, each one   *
+ * loaded and scanned just once however many namelists include it.  They are  *
+ * found by their canonical path and used only while their time and size on   *
+ * disk are as when read; one that has changed is read again into a new       *
+ * entry, and the old one is freed once the last namelist using it closes.    *
+ * A namelist keeps a reference to every file it was read from in its texts,  *
+ * which is its include graph : namelist_changed tells if any of them has     *
+ * changed since it was opened and namelist_depends_on if a given file is     *
+ * one of them.  clear_namelist_cache drops the files no namelist is using.   *
+ ******************************************************************************/
+static void free_incl(NML_Incl *inc)
+{
+    unload_file(inc->text);
+    free_items(inc->item, inc->count);
+    free(inc->path);
+    free(inc);
+}
+/*----------------------------------------------------------------------------*/
+static void drop_incl(NML_Incl *inc)
+{
+    NML_Incl **p;
+
+    for (p = &incl_cache; *p != NULL; p = &(*p)->next)
+        if ( *p == inc ) { *p = inc->next; break; }
+    inc->next = NULL;
+    inc->stale = TRUE;
+    if ( inc->refs == 0 ) free_incl(inc);
+}
+/*----------------------------------------------------------------------------*/
+static void release_incl(NML_Incl *inc)
+{
+    nml_lock(&incl_lock);
+    if ( --inc->refs == 0 && inc->stale ) free_incl(inc);
+    nml_unlock(&incl_lock);
+}
+/*----------------------------------------------------------------------------*/
+/* the cached file, with a reference taken on it for the caller               */
+static NML_Incl *get_incl(const char *iname, int depth)
+{
+    NML_Incl *inc;
+    struct stat st;
+    char *path;
+
+    if ( (path = realpath(iname, NULL)) == NULL || stat(path, &st) != 0 ) {
+        fprintf(stderr, "Could not open include file \"%s\"\n", iname);
+        free(path);
+        return NULL;
     }
-    s++;
-    i = 0;
-    while ( *s != '"' && *s != '\'' && *s != 0 ) tname[i++] = *s++;
-    if ( *s == 0 ) {
-        fprintf(stderr, "Include file declaration must end with a \" or \'\n");
-        free(tname); *fname = NULL;
-        return -1;
+
+    /* held while a file is read, so two threads do not both read it */
+    nml_lock(&incl_lock);
+    for (inc = incl_cache; inc != NULL; inc = inc->next)
+        if ( strcmp(inc->path, path) == 0 ) break;
+    if ( inc != NULL ) {
+        if ( inc->mtime == stat_mtime(&st) && inc->fsize == st.st_size ) {
+            inc->refs++;
+            nml_unlock(&incl_lock);
+            free(path);
+            return inc;
+        }
+        drop_incl(inc);
     }
-    tname[i] = 0;
-    *fname = tname;
-    return 0;
+
+    inc = calloc(1, sizeof(NML_Incl));
+    inc->path = path;
+    inc->mtime = stat_mtime(&st); inc->fsize = st.st_size;
+    if ( (inc->text = load_file(path, &inc->len)) == NULL ) {
+        nml_unlock(&incl_lock);
+        fprintf(stderr, "Could not open include file \"%s\"\n", iname);
+        free(path); free(inc);
+        return NULL;
+    }
+    if ( scan_items(inc->text, inc->len, path, depth, &inc->item, &inc->count) < 0 ) {
+        nml_unlock(&incl_lock);
+        inc->refs = 0; inc->stale = TRUE;
+        free_incl(inc);
+        return NULL;
+    }
+    inc->refs = 1;
+    inc->next = incl_cache;
+    incl_cache = inc;
+    nml_unlock(&incl_lock);
+    return inc;
+}
+/*----------------------------------------------------------------------------*/
+void clear_namelist_cache(void)
+{
+    NML_Incl *inc, *next;
+
+    nml_lock(&incl_lock);
+    for (inc = incl_cache; inc != NULL; inc = next) {
+        next = inc->next;
+        if ( inc->refs == 0 ) drop_incl(inc);
+    }
+    nml_unlock(&incl_lock);
+}
+/*----------------------------------------------------------------------------*/
+int namelist_changed(int file)
+{
+    NML *fl = nml_of(file);
+    struct stat st;
+    int i, n = 0;
+
+    while ( fl->base >= 0 ) fl = nml_of(fl->base);
+    for (i = 0; i < fl->n_text; i++) {
+        NML_Text *t = &fl->text[i];
+        if ( t->fname == NULL ) continue;
+        if ( stat(t->fname, &st) != 0 ||
+                   stat_mtime(&st) != t->mtime || st.st_size != t->fsize ) n++;
+    }
+    return n;
+}
+/*----------------------------------------------------------------------------*/
+int namelist_depends_on(int file, const char *fname)
+{
+    NML *fl = nml_of(file);
+    char *path, *tp;
+    int i, ret = FALSE;
+
+    if ( (path = realpath(fname, NULL)) == NULL ) return FALSE;
+    while ( fl->base >= 0 ) fl = nml_of(fl->base);
+    for (i = 0; !ret && i < fl->n_text; i++) {
+        if ( fl->text[i].fname == NULL ) continue;
+        if ( fl->text[i].incl != NULL )
+            ret = ( strcmp(fl->text[i].fname, path) == 0 );
+        else if ( (tp = realpath(fl->text[i].fname, NULL)) != NULL ) {
+            ret = ( strcmp(tp, path) == 0 );
+            free(tp);
+        }
+    }
+    free(path);
+    return ret;
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
 /******************************************************************************
- *                                                                            *
+ * Add the sections found in a file to the namelist, following its includes.  *
+ * Returns 0 or -1 on an error.                                               *
  ******************************************************************************/
-int open_namelist(const char *fname)
+static int add_items(NML *fl, NML_Item *items, int count, const char *fname, int depth)
 {
-    int nml = -1;
-    FILE *f = fopen(fname, "r");
-    NML *fl = NULL;
+    NML_Section *ns;
+    NML_Incl *inc;
+    NML_Text *t;
+    int i;
 
-    if ( f == NULL ) {
-        fprintf(stderr, "Could not open \"%s\"\n", fname);
-        return -1;
+    for (i = 0; i < count; i++) {
+        NML_Item *it = &items[i];
+
+        if ( it->iname == NULL ) {
+            fl->section = nml_grow(fl, fl->section, fl->count, &fl->size, sizeof(NML_Section));
+            ns = &fl->section[fl->count++];
+            memset(ns, 0, sizeof(NML_Section));
+            ns->name = grab_substring(fl, it->name, it->nlen);
+            ns->start = it->start;
+            ns->end = it->end;
+            ns->thash = it->hash;
+            ns->tlen = it->end - it->start;
+            ns->fname = fname;
+            ns->lineno = it->lineno;
+            continue;
+        }
+
+        if ( depth >= MAX_INCLUDE ) {
+            fprintf(stderr, "Includes nested too deeply in \"%s\"\n", fname);
+            return -1;
+        }
+        if ( (inc = get_incl(it->iname, depth+1)) == NULL ) return -1;
+        fl->text = nml_grow(fl, fl->text, fl->n_text, &fl->text_size, sizeof(NML_Text));
+        t = &fl->text[fl->n_text++];
+        t->text = inc->text; t->len = inc->len;
+        t->fname = inc->path;
+        t->mtime = inc->mtime; t->fsize = inc->fsize;
+        t->hash = 0;
+        t->incl = inc;
+
+        if ( add_items(fl, inc->item, inc->count, inc->path, depth+1) < 0 ) return -1;
     }
+    return 0;
+}
+/*----------------------------------------------------------------------------*/
+/* Returns 0, -1 on an error in the file or -2 if it could not be opened.     */
+static int scan_file(NML *fl, const char *fname)
+{
+    NML_Item *items;
+    NML_Text *t;
+    struct stat st;
+    int count, ret;
+
+    fl->text = nml_grow(fl, fl->text, fl->n_text, &fl->text_size, sizeof(NML_Text));
+    t = &fl->text[fl->n_text];
+    if ( (t->text = load_file(fname, &t->len)) == NULL ) return -2;
+    fl->n_text++;
+
+    t->fname = nml_strdup(fl, fname);
+    t->incl = NULL;
+    t->hash = 0;
+    t->mtime = t->fsize = -1;
+    if ( stat(fname, &st) == 0 ) { t->mtime = stat_mtime(&st); t->fsize = st.st_size; }
+
+    if ( (ret = scan_items(t->text, t->len, t->fname, 0, &items, &count)) == 0 )
+        ret = add_items(fl, items, count, t->fname, 0);
+    free_items(items, count);
+    return ret;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-    nml = list_count++;
-    file_list = realloc(file_list, sizeof(NML)*list_count);
-    fl = &file_list[nml];
-    fl->count = 0; fl->section = NULL;
-    fl->fname = strdup(fname);
 
-    lineno = 0;
-    do  {
-        while ( readline(f, buf) ) {
-            if (strncasecmp(buf, "include ", 8) == 0 ) {
-                push_file(f, fname);
-                get_new_name(buf, &fname);
-                f = fopen(fname, "r");
-                if ( f == NULL ) {
-                    fprintf(stderr, "Could not open include file \"%s\"\n", fname);
-                    return -1;
-                }
-                continue;
-            } else if (buf[0] != '&') {
-                fprintf(stderr, "Error in %sfile \"%s\"\n", (npush)?"included ":"", fname);
-                fprintf(stderr, "\"%s\"\n",buf);
-                list_count--;
-                file_list = realloc(file_list, sizeof(NML)*list_count);
-                nml = -1;
-                break;
+/******************************************************************************
+ *                                                                            *
+ ******************************************************************************/
+static int new_namelist(const char *fname)
+{
+    int nml, i;
+    NML *fl;
+
+    nml_lock(&list_lock);
+    if ( free_slot >= 0 ) {
+        nml = free_slot;
+        free_slot = nml_of(nml)->next_free;
+    } else {
+        if ( list_count % NML_CHUNK == 0 ) {
+            if ( list_count / NML_CHUNK >= NML_CHUNKS ) {
+                nml_unlock(&list_lock);
+                fprintf(stderr, "Too many namelists open to open \"%s\"\n", fname);
+                return -1;
             }
-            fl->count++;
-            fl->section = realloc(fl->section, sizeof(NML_Section)*fl->count);
-            get_section(f, &fl->section[fl->count-1], &buf[1]);
+            fl = calloc(NML_CHUNK, sizeof(NML));
+            for (i = 0; i < NML_CHUNK; i++) nml_lock_init(&fl[i].lock);
+            nml_dir[list_count / NML_CHUNK] = fl;
         }
-    } while ( ! pop_file(&f, &fname) );
+        nml = list_count;
+        store_int(&list_count, nml + 1);
+    }
+    nml_unlock(&list_lock);
+
+    fl = nml_of(nml);
+    fl->count = 0; fl->section = NULL; fl->size = 0;
+    fl->text = NULL; fl->n_text = 0; fl->text_size = 0;
+    fl->retired = NULL; fl->n_retired = 0; fl->retired_size = 0;
+    fl->arena = NULL;
+    fl->base = -1; fl->overlays = 0;
+    fl->watch = -1; fl->gen = 0; fl->checked = 0;
+    fl->next_free = -1;
+    fl->fname = strdup(fname);
+    fl->index = memset(nml_alloc(fl, sizeof(NML_Index)), 0, sizeof(NML_Index));
+    return nml;
+}
+/*----------------------------------------------------------------------------*/
+static void free_namelist(int nml)
+{
+    NML *fl = nml_of(nml);
 
-    fclose(f);
+    free(fl->fname);
+    fl->fname = NULL;
+    unload_texts(fl->text, fl->n_text);
+    unload_texts(fl->retired, fl->n_retired);
+    fl->n_text = fl->n_retired = 0;
+    nml_free_arena(fl);
+    fl->count = 0;
+    fl->section = NULL;
+    fl->index = NULL;
+
+    nml_lock(&list_lock);
+    fl->next_free = free_slot;
+    free_slot = nml;
+    nml_unlock(&list_lock);
+}
+/*----------------------------------------------------------------------------*/
+int open_namelist(const char *fname)
+{
+    int nml = new_namelist(fname), ret;
+    NML *fl;
+    char snap[1024];
+
+    if ( nml < 0 ) return -1;
+    fl = nml_of(nml);
+
+    if ( snapshot_name(fname, snap, sizeof(snap)) && load_snapshot(fl, snap) ) {
+        build_section_hash(fl, fl->index);
+        return nml;
+    }
+
+    if ( (ret = scan_file(fl, fname)) < 0 ) {
+        if ( ret == -2 ) fprintf(stderr, "Could not open \"%s\"\n", fname);
+        free_namelist(nml);
+        return -1;
+    }
+
+    build_section_hash(fl, fl->index);
 #if DEBUG_NML
     show_namelist(nml);
     exit(0);
@@ -466,25 +1079,393 @@ int open_namelist(const char *fname)
 
 
 /******************************************************************************
- *                                                                            *
+ * Entries are found through a hash of the case folded section and entry      *
+ * names.  The section name is hashed on its own first, which finds the       *
+ * section in a table made at open, and so get_namelist need only do that     *
+ * once for all its entries.  A section's entries go into the entry hash as   *
+ * it is parsed, along with any other sections of the same name.              *
  ******************************************************************************/
-static NML_Entry *find_namelist_entry(int file, const char *section, const char *entry)
+static unsigned int hash_mem(unsigned int h, const char *s, size_t n)
 {
-    NML *fl = &file_list[file];
-    int i, j;
+    while ( n-- > 0 ) {
+        h ^= (unsigned char)tolower((unsigned char)*s++);
+        h *= 16777619u;
+    }
+    h ^= 0xFF; h *= 16777619u;  /* so "ab","c" and "a","bc" differ */
+    return h;
+}
+#define hash_name(h, s)    hash_mem(h, s, strlen(s))
+#define HASH_SEED          2166136261u
+#define hash_key(h)        ( (h) ? (h) : 1 )
+/*----------------------------------------------------------------------------*/
+static NML_HTable *new_table(NML *fl, unsigned int size)
+{
+    size_t n = sizeof(NML_HTable) + (size - 1) * sizeof(NML_HSlot);
+    NML_HTable *t = memset(nml_alloc(fl, n), 0, n);
+
+    t->mask = size - 1;
+    return t;
+}
+/*----------------------------------------------------------------------------*/
+/* the sections of fl as they are now into the section table of ix, which    */
+/* must not yet be where readers can see it                                  */
+static void build_section_hash(NML *fl, NML_Index *ix)
+{
+    unsigned int size = 16, h, k;
+    NML_HTable *t;
+    int i;
+
+    while ( size < (unsigned int)fl->count * 2 ) size *= 2;
+    ix->shash = t = new_table(fl, size);
+    t->count = fl->count;
 
     for (i = 0; i < fl->count; i++) {
-        NML_Section *ns = &fl->section[i];
-        if ( strcasecmp(section, ns->name) != 0 ) continue;
+        NML_Section *ns = &fl->section[i], *p;
 
-        for (j = 0; j < ns->count; j++) {
-             NML_Entry *ne = &ns->entry[j];
+        h = hash_key(hash_name(HASH_SEED, ns->name));
+        for (k = h & t->mask; t->slot[k].h != 0; k = (k + 1) & t->mask)
+            if ( t->slot[k].h == h &&
+                 strcasecmp(t->slot[k].sect->name, ns->name) == 0 ) break;
 
-             if ( strcasecmp(entry, ne->name) == 0 ) return ne;
+        if ( t->slot[k].h != 0 ) {
+            /* a repeat, chain it on the end of the first */
+            for (p = t->slot[k].sect; p->next != NULL; p = p->next) ;
+            p->next = ns;
+        } else {
+            t->slot[k].h = h;
+            t->slot[k].sect = ns;
+        }
+    }
+}
+/*----------------------------------------------------------------------------*/
+/* called with the namelist locked; readers may be looking at the table all */
+/* the while, so a slot is filled before its h is set and a grown table is   */
+/* complete before it replaces the old one (which is left as it was)        */
+static void add_entry_hash(NML *fl, NML_Index *ix, unsigned int hs,
+                                                  NML_Section *ns, NML_Entry *ne)
+{
+    NML_HTable *t = ix->hash, *old;
+    NML_HSlot *sl;
+    unsigned int h, k, j;
+
+    if ( t == NULL || (t->count + 1) * 2 > t->mask + 1 ) {
+        old = t;
+        t = new_table(fl, ( old == NULL ) ? 64 : (old->mask + 1) * 2);
+        for (j = 0; old != NULL && j <= old->mask; j++) {
+            if ( old->slot[j].h == 0 ) continue;
+            for (k = old->slot[j].h & t->mask; t->slot[k].h != 0; k = (k + 1) & t->mask) ;
+            t->slot[k] = old->slot[j];
         }
+        t->count = ( old != NULL ) ? old->count : 0;
+        store_ptr(&ix->hash, t);
     }
+
+    h = hash_key(hash_name(hs, ne->name));
+    for (k = h & t->mask; t->slot[k].h != 0; k = (k + 1) & t->mask)
+        if ( t->slot[k].h == h &&
+             strcasecmp(t->slot[k].sect->name, ns->name) == 0 &&
+             strcasecmp(t->slot[k].entry->name, ne->name) == 0 )
+            return;     /* the first of any repeats is the one that is found */
+
+    sl = &t->slot[k];
+    sl->sect = ns;
+    sl->entry = ne;
+    store_int(&sl->h, h);
+    t->count++;
+}
+/*----------------------------------------------------------------------------*/
+static NML_Section *lookup_section(NML_Index *ix, unsigned int hs, const char *section)
+{
+    unsigned int h = hash_key(hs), k;
+    NML_HTable *t = ix->shash;
+
+    if ( t == NULL ) return NULL;
+
+    for (k = h & t->mask; t->slot[k].h != 0; k = (k + 1) & t->mask)
+        if ( t->slot[k].h == h &&
+             strcasecmp(t->slot[k].sect->name, section) == 0 ) break;
+    return t->slot[k].sect;
+}
+/*----------------------------------------------------------------------------*/
+/* the first to ask for a section parses it, with the namelist locked, and   */
+/* then marks it hashed; once it is, no lock is needed to read it           */
+static NML_Section *find_section(NML *fl, NML_Index *ix, unsigned int hs,
+                                                         const char *section)
+{
+    NML_Section *ns, *p;
+    NML_Scan sc;
+    int j;
+
+    if ( (ns = lookup_section(ix, hs, section)) == NULL ) return NULL;
+    if ( load_int(&ns->hashed) ) return ns;
+
+    nml_lock(&fl->lock);
+    if ( !ns->hashed ) {
+        for (p = ns; p != NULL; p = p->next) {
+            if ( !p->parsed ) {
+                sc.p = p->start; sc.end = p->end;
+                sc.fname = p->fname; sc.lineno = p->lineno;
+                get_section(&sc, fl, p);
+                p->parsed = TRUE;
+            }
+            for (j = 0; j < p->count; j++)
+                add_entry_hash(fl, ix, hs, p, &p->entry[j]);
+            if ( p != ns ) p->hashed = TRUE;
+        }
+        store_int(&ns->hashed, TRUE);
+    }
+    nml_unlock(&fl->lock);
+    return ns;
+}
+/*----------------------------------------------------------------------------*/
+static NML_HSlot *find_slot(NML *fl, unsigned int hs,
+                                       const char *section, const char *entry)
+{
+    NML_Index *ix = load_ptr(&fl->index);
+    NML_HTable *t;
+    unsigned int h, k, sh;
+
+    /* an overlay has no sections, just the entries set in it */
+    if ( fl->base < 0 && find_section(fl, ix, hs, section) == NULL ) return NULL;
+    if ( (t = load_ptr(&ix->hash)) == NULL ) return NULL;
+
+    h = hash_key(hash_name(hs, entry));
+    for (k = h & t->mask; (sh = load_int(&t->slot[k].h)) != 0; k = (k + 1) & t->mask)
+        if ( sh == h &&
+             strcasecmp(t->slot[k].sect->name, section) == 0 &&
+             strcasecmp(((NML_Entry*)load_ptr(&t->slot[k].entry))->name, entry) == 0 )
+            return &t->slot[k];
     return NULL;
 }
+/*----------------------------------------------------------------------------*/
+static NML_Entry *find_entry_hashed(NML *fl, unsigned int hs,
+                                       const char *section, const char *entry)
+{
+    NML_HSlot *sl = find_slot(fl, hs, section, entry);
+    return ( sl != NULL ) ? load_ptr(&sl->entry) : NULL;
+}
+/*----------------------------------------------------------------------------*/
+/* an overlay's own entries first, then those of what it is laid over, with  */
+/* *flp left as the namelist the entry was found in                           */
+static NML_Entry *resolve_entry(NML **flp, unsigned int hs,
+                                       const char *section, const char *entry)
+{
+    NML *fl = *flp;
+    NML_Entry *ne;
+
+    for (;;) {
+        if ( (ne = find_entry_hashed(fl, hs, section, entry)) != NULL ) {
+            *flp = fl;
+            return ne;
+        }
+        if ( fl->base < 0 ) return NULL;
+        fl = nml_of(fl->base);
+    }
+}
+/*----------------------------------------------------------------------------*/
+static NML_Entry *find_namelist_entry(int file, const char *section, const char *entry)
+{
+    NML *fl = nml_of(file);
+    return resolve_entry(&fl, hash_name(HASH_SEED, section), section, entry);
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Watching.  A namelist opened for a long run can be watched for changes to  *
+ * the files it was read from : once watch_namelist has been called on it,    *
+ * poll_namelist checks the time and size of each of them (no more often      *
+ * than every interval seconds) and, if any has changed, reads them again.    *
+ * Sections whose text is byte for byte as it was keep their parsed entries;  *
+ * the rest are parsed again when next asked for.  Each reload that changes   *
+ * anything adds one to the namelist's generation, and each section records   *
+ * the generation it last changed in, so nml_section_changed tells a caller   *
+ * that saw generation since whether that section has changed after it.  A    *
+ * section that has gone keeps a place, empty, so that it too shows as        *
+ * changed.  Values got before a reload stay as they were, in the arena.      *
+ * A reload builds its section tables and index beside the old ones and only  *
+ * then swaps the index in, so threads reading the namelist meanwhile see it  *
+ * all as it was or all as it is.  The old tables, and the texts they point   *
+ * into, are kept until the namelist is closed.                               *
+ ******************************************************************************/
+/* the old text may already have been written over, or have come from a       */
+/* snapshot and never been here at all, so compare hashes of it               */
+static int same_text(const NML_Section *os, const NML_Section *ns)
+{
+    return ( os->thash != 0 && os->thash == ns->thash && os->tlen == ns->tlen );
+}
+/*----------------------------------------------------------------------------*/
+static int reload_namelist(NML *fl)
+{
+    NML old = *fl;
+    NML_Index *ix;
+    NML_HTable *t;
+    NML_Section *ns, *os, *p;
+    unsigned int k;
+    int i, n, changed = FALSE, gen = fl->gen + 1;
+
+    fl->section = NULL; fl->count = 0; fl->size = 0;
+    fl->text = NULL; fl->n_text = 0; fl->text_size = 0;
+
+    if ( scan_file(fl, fl->fname) < 0 ) {
+        fprintf(stderr, "Keeping namelist \"%s\" as it was\n", fl->fname);
+        unload_texts(fl->text, fl->n_text);
+        fl->section = old.section; fl->count = old.count; fl->size = old.size;
+        fl->text = old.text; fl->n_text = old.n_text; fl->text_size = old.text_size;
+        return -1;
+    }
+    ix = memset(nml_alloc(fl, sizeof(NML_Index)), 0, sizeof(NML_Index));
+    build_section_hash(fl, ix);
+
+    /* pair each section with the one of the same name (and repeat) before */
+    for (t = ix->shash, k = 0; k <= t->mask; k++) {
+        if ( t->slot[k].h == 0 ) continue;
+        ns = t->slot[k].sect;
+        os = lookup_section(old.index, hash_name(HASH_SEED, ns->name), ns->name);
+        for (p = ns; p != NULL; p = p->next, os = ( os != NULL ) ? os->next : NULL) {
+            if ( os != NULL && same_text(os, p) ) {
+                p->entry = os->entry;
+                p->count = os->count;
+                p->size = os->size;
+                p->parsed = os->parsed;
+                p->gen = os->gen;
+            } else {
+                p->gen = gen;
+                changed = TRUE;
+            }
+        }
+        if ( os != NULL ) { ns->gen = gen; changed = TRUE; }
+    }
+
+    /* and keep an empty place for those that have gone */
+    n = fl->count;
+    for (t = old.index->shash, k = 0; t != NULL && k <= t->mask; k++) {
+        if ( t->slot[k].h == 0 ) continue;
+        os = t->slot[k].sect;
+        if ( lookup_section(ix, hash_name(HASH_SEED, os->name), os->name) != NULL ) continue;
+        fl->section = nml_grow(fl, fl->section, fl->count, &fl->size, sizeof(NML_Section));
+        ns = &fl->section[fl->count++];
+        memset(ns, 0, sizeof(NML_Section));
+        ns->name = os->name;
+        ns->parsed = TRUE;
+        ns->gone = TRUE;
+        ns->gen = ( os->gone ) ? os->gen : gen;
+        if ( !os->gone ) changed = TRUE;
+    }
+    /* the table may have moved as well as grown, so hash it all again */
+    if ( fl->count != n ) {
+        for (i = 0; i < fl->count; i++) fl->section[i].next = NULL;
+        build_section_hash(fl, ix);
+    }
+
+    /* the files read before are no longer sources, but readers of the old   */
+    /* index may still parse sections from them; a snapshot stays a source   */
+    for (i = 0; i < old.n_text; i++) {
+        NML_Text *ot = &old.text[i];
+        if ( ot->fname == NULL ) {
+            fl->text = nml_grow(fl, fl->text, fl->n_text, &fl->text_size, sizeof(NML_Text));
+            fl->text[fl->n_text++] = *ot;
+        } else {
+            fl->retired = nml_grow(fl, fl->retired, fl->n_retired, &fl->retired_size, sizeof(NML_Text));
+            fl->retired[fl->n_retired++] = *ot;
+        }
+    }
+
+    if ( changed ) fl->gen = gen;
+    store_ptr(&fl->index, ix);
+    return 0;
+}
+/*----------------------------------------------------------------------------*/
+int watch_namelist(int file, int interval)
+{
+    NML *fl = nml_of(file);
+
+    while ( fl->base >= 0 ) fl = nml_of(fl->base);
+    fl->watch = interval;
+    fl->checked = time(NULL);
+    return fl->gen;
+}
+/*----------------------------------------------------------------------------*/
+int poll_namelist(int file)
+{
+    NML *fl = nml_of(file);
+    time_t now;
+    int ret;
+
+    while ( fl->base >= 0 ) fl = nml_of(fl->base);
+    if ( fl->watch < 0 ) return fl->gen;
+
+    now = time(NULL);
+    if ( now - fl->checked < fl->watch ) return fl->gen;
+    fl->checked = now;
+
+    if ( namelist_changed(file) ) {
+        nml_lock(&fl->lock);
+        ret = reload_namelist(fl);
+        nml_unlock(&fl->lock);
+        if ( ret < 0 ) return -1;
+    }
+    return fl->gen;
+}
+/*----------------------------------------------------------------------------*/
+int nml_section_changed(int file, const char *section, int since)
+{
+    NML *fl = nml_of(file);
+    NML_Section *ns;
+
+    while ( fl->base >= 0 ) fl = nml_of(fl->base);
+    ns = lookup_section(load_ptr(&fl->index), hash_name(HASH_SEED, section), section);
+    for ( ; ns != NULL; ns = ns->next)
+        if ( ns->gen > since ) return TRUE;
+    return FALSE;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Fill arr with the values of an entry as type, writing out any repeats.     *
+ ******************************************************************************/
+#define run_len(ne, j)     ( ((ne)->rep != NULL) ? (ne)->rep[j] : 1 )
+
+static void expand_values(NML_Entry *ne, int type, void *arr)
+{
+    int i, j, k;
+
+    for (i = j = 0; j < ne->nval; j++)
+        for (k = run_len(ne, j); k > 0; k--, i++)
+            switch (type & MASK_TYPE) {
+                case TYPE_INT    : ((int*)arr)[i] = ne->data[j].i; break;
+                case TYPE_DOUBLE : ((double*)arr)[i] = ne->data[j].r; break;
+                case TYPE_STR    : ((char**)arr)[i] = ne->data[j].s; break;
+                case TYPE_BOOL   : ((int*)arr)[i] = ne->data[j].b; break;
+            }
+}
+/*----------------------------------------------------------------------------*/
+/* ints written without a '.' asked for as reals : a copy of the entry with   */
+/* the values made doubles, built once by whoever asks first.  The entry      */
+/* itself is never changed, as others may be reading it as ints unlocked.     */
+static NML_Entry *ints_to_reals(NML *fl, NML_Entry *ne)
+{
+    NML_Entry *re;
+    int i;
+
+    if ( (re = load_ptr(&ne->reals)) != NULL ) return re;
+
+    nml_lock(&fl->lock);
+    if ( (re = ne->reals) == NULL ) {
+        re = nml_alloc(fl, sizeof(NML_Entry));
+        *re = *ne;
+        re->type = TYPE_DOUBLE | (ne->type & MASK_LIST);
+        re->size = ne->nval;
+        re->data = nml_alloc(fl, (ne->nval + 1) * sizeof(NML_Value));
+        for (i = 0; i < ne->nval; i++) re->data[i].r = ne->data[i].i;
+        re->view = NULL;
+        re->reals = NULL;
+        store_ptr(&ne->reals, re);
+    }
+    nml_unlock(&fl->lock);
+    return re;
+}
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
@@ -505,55 +1486,50 @@ int get_nml_listlen(int file, const char *section, const char *entry)
  ******************************************************************************/
 int get_namelist(int file, NAMELIST *nl)
 {
+    NML *fl = nml_of(file);
     const char *section;
-    int i, ret = -1;
+    unsigned int hs;
+    int ret = -1;
 
     if (nl->type != TYPE_START) return -1;
     section = nl->name;
+    hs = hash_name(HASH_SEED, section);
     nl++;
 
     while (nl->type != TYPE_END) {
-        NML_Entry *ne = find_namelist_entry(file, section, nl->name);
+        NML *owner = fl;
+        NML_Entry *ne = resolve_entry(&owner, hs, section, nl->name);
 
         if (ne != NULL) {
             ret = 0;
 
             // this is a fudge for the case where we've asked for reals but the config
             // has forgotten to put in a '.' so we've seen it as ints.
-            if ( (nl->type & MASK_TYPE) == TYPE_DOUBLE &&
-                 (ne->type & MASK_TYPE) == TYPE_INT ) {
-                NML_Value *tr = malloc((ne->count+2)*sizeof(NML_Value));
-                for (i = 0; i < ne->count; i++) tr[i].r = ne->data[i].i;
-                free(ne->data);
-                ne->data = tr;
-                ne->type = TYPE_DOUBLE | (ne->type & MASK_LIST);
-            }
+            if ( (nl->type & MASK_TYPE) == TYPE_DOUBLE && (ne->type & MASK_TYPE) == TYPE_INT )
+                ne = ints_to_reals(owner, ne);
 
+            // lists are copied into the arena too, so they last until the
+            // namelist is closed and the entry itself is left as it was.
             if ( (nl->type & MASK_LIST) ) {
-                int count = ne->count, nofree=FALSE;
+                int count = ne->count;
                 switch (nl->type & MASK_TYPE) {
                     case TYPE_INT :
-                        *((void**)(nl->data)) = malloc((count+2)*sizeof(int));
-                        for (i = 0; i < count; i++) (*((int**)(nl->data)))[i] = ne->data[i].i;
+                    case TYPE_BOOL :
+                        *((void**)(nl->data)) = nml_alloc_locked(fl, (count+2)*sizeof(int));
+                        expand_values(ne, nl->type, *((void**)(nl->data)));
                         break;
                     case TYPE_DOUBLE :
-                        *((void**)(nl->data)) = malloc((count+2)*sizeof(double));
-                        for (i = 0; i < count; i++) (*((double**)(nl->data)))[i] = ne->data[i].r;
+                        *((void**)(nl->data)) = nml_alloc_locked(fl, (count+2)*sizeof(double));
+                        expand_values(ne, nl->type, *((void**)(nl->data)));
                         break;
                     case TYPE_STR :
-                        *((void**)(nl->data)) = malloc((count+2)*sizeof(char**));
-                        for (i = 0; i < count; i++) (*((char***)(nl->data)))[i] = ne->data[i].s;
-                        break;
-                    case TYPE_BOOL :
-                        *((void**)(nl->data)) = malloc((count+2)*sizeof(int));
-                        for (i = 0; i < count; i++) (*((int**)(nl->data)))[i] = ne->data[i].b;
+                        *((void**)(nl->data)) = nml_alloc_locked(fl, (count+2)*sizeof(char**));
+                        expand_values(ne, nl->type, *((void**)(nl->data)));
                         break;
                     default :
                         fprintf(stderr, "    Value of unknown type %d\n", ne->type);
-                        nofree=TRUE;
                         break;
                 }
-                if (!nofree) { free(ne->data); ne->data = *((void**)(nl->data)); }
             } else {
                 switch (nl->type & MASK_TYPE) {
                     case TYPE_INT :
@@ -584,6 +1560,334 @@ int get_namelist(int file, NAMELIST *nl)
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 
+/******************************************************************************
+ * A read only view of the values of an entry, as an array of the type asked  *
+ * for, owned by the namelist and good until it is closed.  Doubles (and      *
+ * strings where pointers are 8 bytes) are the parsed values themselves, as   *
+ * an NML_Value is the same size; ints and logicals, or values with repeats,  *
+ * are written out into an array the first time and that is kept.  As with    *
+ * get_namelist, integers asked for as doubles are given from a converted     *
+ * copy, made once and kept.                                                  *
+ * Returns NULL, with *len 0, if there is no such entry or its values are not *
+ * of that type.                                                              *
+ ******************************************************************************/
+const void *get_nml_view(int file, const char *section, const char *entry,
+                                                           int type, int *len)
+{
+    NML *fl = nml_of(file);
+    NML_Entry *ne = resolve_entry(&fl, hash_name(HASH_SEED, section), section, entry);
+    size_t isz = sizeof(int);
+    void *view;
+
+    /* fl is now the owner of the entry, which is where any view is kept */
+    *len = 0;
+    if ( ne == NULL ) return NULL;
+
+    if ( (type & MASK_TYPE) == TYPE_DOUBLE && (ne->type & MASK_TYPE) == TYPE_INT )
+        ne = ints_to_reals(fl, ne);
+    if ( (ne->type & MASK_TYPE) != (type & MASK_TYPE) ) return NULL;
+    *len = ne->count;
+
+    switch (type & MASK_TYPE) {
+        case TYPE_DOUBLE :
+            if ( ne->rep == NULL ) return &ne->data[0].r;
+            isz = sizeof(double);
+            break;
+        case TYPE_STR :
+            if ( ne->rep == NULL && sizeof(NML_Value) == sizeof(char*) ) return &ne->data[0].s;
+            isz = sizeof(char*);
+            break;
+        case TYPE_INT :
+        case TYPE_BOOL :
+            break;
+        default :
+            *len = 0;
+            return NULL;
+    }
+    if ( (view = load_ptr(&ne->view)) == NULL ) {
+        nml_lock(&fl->lock);
+        if ( (view = ne->view) == NULL ) {
+            view = nml_alloc(fl, (ne->count+1) * isz);
+            expand_values(ne, type, view);
+            store_ptr(&ne->view, view);
+        }
+        nml_unlock(&fl->lock);
+    }
+    return view;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Schema directed reading.  get_namelist_typed takes the same list as        *
+ * get_namelist but, for a section not yet read, decodes the values for the   *
+ * entries asked for straight from the file text into the types asked for :   *
+ * one conversion per value, no guessing the type and no tree of entries in   *
+ * between.  Other entries are stepped over without being decoded.  A value   *
+ * that is not of the type asked for is reported and left out.                *
+ ******************************************************************************/
+static int decode_typed(NML *fl, int type, const char *s, size_t n, int quoted, NML_Value *v)
+{
+    char tmp[128], *t, *e;
+
+    if ( (type & MASK_TYPE) == TYPE_STR ) {
+        v->s = grab_substring(fl, s, n);
+        return TRUE;
+    }
+    if ( quoted ) return FALSE;
+
+    t = ( n < sizeof(tmp) ) ? copy_substring(tmp, s, n) : grab_substring(fl, s, n);
+    while ( *t == ' ' || *t == '\t' ) t++;
+    switch (type & MASK_TYPE) {
+        case TYPE_INT :
+            v->i = strtoll(t, &e, 10);
+            break;
+        case TYPE_DOUBLE :
+            v->r = strtod(t, &e);
+            break;
+        case TYPE_BOOL :
+            e = t;
+            if ( *e == '.' ) e++;
+            if ( *e == 't' || *e == 'T' ) v->b = TRUE;
+            else if ( *e == 'f' || *e == 'F' ) v->b = FALSE;
+            else return FALSE;
+            return TRUE;
+        default :
+            return FALSE;
+    }
+    while ( *e == ' ' || *e == '\t' ) e++;
+    return ( e != t && *e == 0 );
+}
+/*----------------------------------------------------------------------------*/
+static void *typed_room(NML *fl, void *arr, int count, int *size, size_t isz)
+{
+    void *n;
+
+    /* as get_namelist does, leave room for two past the end */
+    if ( count + 2 <= *size ) return arr;
+    *size = ( *size == 0 ) ? 8 : *size * 2;
+    n = nml_alloc(fl, *size * isz);
+    if ( count > 0 ) memcpy(n, arr, count * isz);
+    return n;
+}
+/*----------------------------------------------------------------------------*/
+static void store_typed(NML *fl, NAMELIST *d, NML_Value *v, int count, int *size)
+{
+    void **list = (void**)(d->data);
+
+    if ( !(d->type & MASK_LIST) ) {
+        switch (d->type & MASK_TYPE) {
+            case TYPE_INT    : *((int*)(d->data)) = v->i; break;
+            case TYPE_DOUBLE : *((double*)(d->data)) = v->r; break;
+            case TYPE_STR    : *((char**)(d->data)) = v->s; break;
+            case TYPE_BOOL   : *((_Bool*)(d->data)) = v->b; break;
+        }
+        return;
+    }
+    switch (d->type & MASK_TYPE) {
+        case TYPE_INT :
+            *list = typed_room(fl, *list, count, size, sizeof(int));
+            ((int*)*list)[count] = v->i;
+            break;
+        case TYPE_DOUBLE :
+            *list = typed_room(fl, *list, count, size, sizeof(double));
+            ((double*)*list)[count] = v->r;
+            break;
+        case TYPE_STR :
+            *list = typed_room(fl, *list, count, size, sizeof(char*));
+            ((char**)*list)[count] = v->s;
+            break;
+        case TYPE_BOOL :
+            *list = typed_room(fl, *list, count, size, sizeof(int));
+            ((int*)*list)[count] = v->b;
+            break;
+    }
+}
+/*----------------------------------------------------------------------------*/
+static int read_section_typed(NML *fl, NML_Section *ns, NAMELIST *nl, int n,
+                                               unsigned int *hn, char *seen)
+{
+    NML_Scan sc;
+    NML_Value v;
+    NAMELIST *d;
+    const char *ls, *le, *r, *s;
+    size_t len;
+    int k, nlen, count, size, quoted, rep, found = FALSE;
+    unsigned int h;
+
+    sc.p = ns->start; sc.end = ns->end;
+    sc.fname = ns->fname; sc.lineno = ns->lineno;
+
+    if ( !scan_line(&sc, &ls, &le) ) return FALSE;
+    while ( !is_end_line(ls, le) ) {
+        r = trim_buf_name(&sc, ls, le, &nlen);
+        h = hash_key(hash_mem(HASH_SEED, ls, nlen));
+        for (k = 0; k < n; k++)
+            if ( hn[k] == h && strncasecmp(nl[k].name, ls, nlen) == 0 &&
+                                                      nl[k].name[nlen] == 0 ) break;
+        d = NULL;
+        if ( k < n && !seen[k] ) {
+            /* the first of any repeats is the one that is used */
+            d = &nl[k]; seen[k] = TRUE; found = TRUE;
+            if ( d->type & MASK_LIST ) *((void**)(d->data)) = NULL;
+        }
+        count = 0; size = 0;
+
+        for (;;) {
+            while ( d != NULL && r < le ) {
+                quoted = next_value(&r, le, &s, &len, &rep);
+                if ( rep == 0 || (len == 0 && !quoted) ) continue;
+                if ( count > INT_MAX - rep ) {
+                    fprintf(stderr, "Too many values for %s in \"%s\" at %d\n",
+                                                      d->name, sc.fname, sc.lineno);
+                    continue;
+                }
+                if ( !decode_typed(fl, d->type, s, len, quoted, &v) ) {
+                    fprintf(stderr, "Value \"%.*s\" of %s in \"%s\" at %d is not of the type asked for\n",
+                                          (int)len, s, d->name, sc.fname, sc.lineno);
+                    continue;
+                }
+                if ( !(d->type & MASK_LIST) ) {
+                    store_typed(fl, d, &v, count++, &size);
+                    d = NULL;   /* just the one */
+                } else
+                    while ( rep-- > 0 ) store_typed(fl, d, &v, count++, &size);
+            }
+            if ( !scan_line(&sc, &ls, &le) ) return found;
+            if ( is_end_line(ls, le) || memchr(ls, '=', le - ls) != NULL ) break;
+            r = ls;
+        }
+        if ( d != NULL && (d->type & MASK_LIST) ) {
+            void **list = (void**)(d->data);
+            size_t isz = ( (d->type & MASK_TYPE) == TYPE_DOUBLE ) ? sizeof(double) :
+                         ( (d->type & MASK_TYPE) == TYPE_STR ) ? sizeof(char*) : sizeof(int);
+            *list = typed_room(fl, *list, count, &size, isz);
+        }
+    }
+    return found;
+}
+/*----------------------------------------------------------------------------*/
+int get_namelist_typed(int file, NAMELIST *nl)
+{
+    NML *fl = nml_of(file);
+    NML_Section *ns, *p;
+    unsigned int hs, *hn;
+    char *seen;
+    int i, n, ret = -1;
+
+    if (nl->type != TYPE_START) return -1;
+
+    /* entries of an overlay may come from anywhere, so look each one up */
+    if ( fl->base >= 0 ) return get_namelist(file, nl);
+
+    hs = hash_name(HASH_SEED, nl->name);
+    if ( (ns = lookup_section(load_ptr(&fl->index), hs, nl->name)) == NULL ) return -1;
+
+    /* already read for someone else, so take it from there */
+    if ( load_int(&ns->parsed) ) return get_namelist(file, nl);
+
+    for (n = 0; nl[n+1].type != TYPE_END; n++) ;
+    hn = malloc((n+1) * sizeof(unsigned int));
+    seen = calloc(n+1, 1);
+    for (i = 0; i < n; i++) hn[i] = hash_key(hash_name(HASH_SEED, nl[i+1].name));
+
+    /* this takes from the arena, so it is done with the namelist locked */
+    nml_lock(&fl->lock);
+    if ( ns->parsed ) {
+        nml_unlock(&fl->lock);
+        free(hn); free(seen);
+        return get_namelist(file, nl);
+    }
+    for (p = ns; p != NULL; p = p->next)
+        if ( read_section_typed(fl, p, nl+1, n, hn, seen) ) ret = 0;
+    nml_unlock(&fl->lock);
+
+    free(hn); free(seen);
+    return ret;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ * Overlays.  open_namelist_overlay makes a handle laid over an open namelist *
+ * (or over another overlay) that starts with nothing of its own : every      *
+ * entry is looked up in what it is laid over, sharing that namelist's parsed *
+ * values.  set_namelist_entry then gives an entry of the overlay a value of  *
+ * its own, written as it would be in the file, e.g. "0.5" or "3*1.0, 2.0",   *
+ * which is found before the one underneath.  Nothing of the base is copied   *
+ * or changed, so many overlays can share one base.  Each namelist counts the *
+ * overlays laid over it and will not be closed while there are any, so the   *
+ * handle an overlay holds can never come to mean another namelist.           *
+ ******************************************************************************/
+int open_namelist_overlay(int base)
+{
+    NML *bl;
+    int nml;
+
+    nml_lock(&list_lock);
+    if ( base < 0 || base >= list_count ||
+         (bl = nml_of(base))->fname == NULL || bl->overlays < 0 ) {
+        nml_unlock(&list_lock);
+        fprintf(stderr, "No open namelist %d to lay an overlay over\n", base);
+        return -1;
+    }
+    bl->overlays++;
+    nml_unlock(&list_lock);
+
+    if ( (nml = new_namelist(bl->fname)) >= 0 )
+        nml_of(nml)->base = base;
+    else {
+        nml_lock(&list_lock);
+        bl->overlays--;
+        nml_unlock(&list_lock);
+    }
+    return nml;
+}
+/*----------------------------------------------------------------------------*/
+int set_namelist_entry(int file, const char *section, const char *entry,
+                                                             const char *text)
+{
+    NML *fl = nml_of(file);
+    NML_Section *ns;
+    NML_Entry *ne;
+    NML_HSlot *sl;
+    const char *e;
+    unsigned int hs;
+
+    if ( fl->base < 0 ) {
+        fprintf(stderr, "Entries can only be set in an overlay of \"%s\"\n", fl->fname);
+        return -1;
+    }
+    while ( *text == ' ' || *text == '\t' ) text++;
+    for (e = text + strlen(text); e > text && (e[-1] == ' ' || e[-1] == '\t'); e--) ;
+    if ( e == text ) {
+        fprintf(stderr, "No value given for %s in &%s\n", entry, section);
+        return -1;
+    }
+
+    nml_lock(&fl->lock);
+    ne = memset(nml_alloc(fl, sizeof(NML_Entry)), 0, sizeof(NML_Entry));
+    ne->name = nml_strdup(fl, entry);
+    extract_values(fl, ne, text, e);
+
+    /* a value set again replaces the one before, which is left as it was */
+    hs = hash_name(HASH_SEED, section);
+    if ( (sl = find_slot(fl, hs, section, entry)) != NULL )
+        store_ptr(&sl->entry, ne);
+    else {
+        ns = memset(nml_alloc(fl, sizeof(NML_Section)), 0, sizeof(NML_Section));
+        ns->name = nml_strdup(fl, section);
+        ns->count = ns->size = 1;
+        ns->entry = ne;
+        ns->parsed = ns->hashed = TRUE;
+        add_entry_hash(fl, fl->index, hs, ns, ne);
+    }
+    nml_unlock(&fl->lock);
+    return 0;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
 #if DEBUG_NML
 /******************************************************************************
  *                                                                            *
@@ -600,9 +1904,10 @@ static void show_entry(NML_Entry *ne)
         default          : ts = "TYPE_UNKNOWN"; break;
     }
     fprintf(stderr, "  Entry %s has %d %s values\n", ne->name, ne->count, ts);
-    for (k = 0; k < ne->count; k++) {
+    for (k = 0; k < ne->nval; k++) {
+        if ( run_len(ne, k) > 1 ) fprintf(stderr, "   %d times\n", run_len(ne, k));
         switch (ne->type) {
-            case TYPE_INT    : fprintf(stderr, "   Value : %ld\n", ne->data[k].i); break;
+            case TYPE_INT    : fprintf(stderr, "   Value : %lld\n", ne->data[k].i); break;
             case TYPE_DOUBLE : fprintf(stderr, "   Value : %12.4f\n", ne->data[k].r); break;
             case TYPE_STR    : fprintf(stderr, "   Value : \"%s\"\n", (ne->data[k].s)?ne->data[k].s:"NULL"); break;
             case TYPE_BOOL   : fprintf(stderr, "   Value : %s\n", (ne->data[k].b)?"TRUE":"FALSE"); break;
@@ -618,11 +1923,12 @@ static void show_entry(NML_Entry *ne)
  ******************************************************************************/
 static void show_namelist(int file)
 {
-    NML *fl = &file_list[file];
+    NML *fl = nml_of(file);
     int i, j;
 
     for (i = 0; i < fl->count; i++) {
         NML_Section *ns = &fl->section[i];
+        find_section(fl, fl->index, hash_name(HASH_SEED, ns->name), ns->name);
         fprintf(stderr, "Section %s has %d entries\n", ns->name, ns->count);
         for (j = 0; j < ns->count; j++)
             show_entry(&ns->entry[j]);
@@ -633,36 +1939,406 @@ static void show_namelist(int file)
 
 
 /******************************************************************************
+ * Snapshots.  save_namelist_snapshot reads every section of a namelist and   *
+ * writes the lot, with its includes resolved, to a binary file (by default   *
+ * the namelist file name with ".snap" on the end).  open_namelist looks for  *
+ * that file first and, if it is there and its sources are unchanged, reads   *
+ * it and points the sections and entries straight at it, so no text is       *
+ * scanned or typed at all.  A source counts as unchanged if its time and     *
+ * size are as recorded or, failing the time, its contents hash the same.     *
  *                                                                            *
+ * All offsets are from the start of the file.  String values are stored as   *
+ * offsets and made into pointers on loading; other values are used in place. *
+ * The header holds a hash of the rest, and a snapshot that fails it or any   *
+ * of the checks on its offsets and counts is ignored and the text parsed.    *
  ******************************************************************************/
-void close_namelist(int file)
+#define SNAP_MAGIC     "AEDNMLSN"
+#define SNAP_VERSION   3
+#define SNAP_ENDIAN    0x01020304
+
+typedef struct _snap_hdr {
+    char     magic[8];
+    uint32_t version, endian, value_size, n_src;
+    uint32_t n_sect, n_entry;
+    uint64_t off_src, off_sect, off_entry, size;
+    uint64_t check;          /* hash_text of everything after the header */
+} SNAP_Header;
+
+typedef struct _snap_src {
+    int64_t  mtime, fsize;
+    uint64_t hash, name;
+} SNAP_Source;
+
+typedef struct _snap_sect {
+    uint64_t name;
+    uint64_t thash, tlen;    /* of its text, so a reload can tell it changed */
+    uint32_t first, count;
+} SNAP_Section;
+
+typedef struct _snap_entry {
+    uint64_t name, data, rep;
+    int32_t  type, count, nval, pad;
+} SNAP_Entry;
+
+/* a growing buffer the snapshot is built in */
+typedef struct _snap_buf {
+    char  *b;
+    size_t len, cap;
+} SNAP_Buf;
+
+/*----------------------------------------------------------------------------*/
+static int snapshot_name(const char *fname, char *sname, size_t len)
+{
+    return ( (size_t)snprintf(sname, len, "%s.snap", fname) < len );
+}
+/*----------------------------------------------------------------------------*/
+/* add n bytes (zeros if p is NULL) aligned to 8, returning their offset      */
+static uint64_t snap_put(SNAP_Buf *sb, const void *p, size_t n)
 {
-    NML *fl = &file_list[file];
-    int i, j, k, err = 0;
+    size_t off = (sb->len + 7) & ~(size_t)7;
 
-    free(fl->fname);
+    if ( off + n > sb->cap ) {
+        while ( off + n > sb->cap ) sb->cap = ( sb->cap == 0 ) ? 65536 : sb->cap * 2;
+        sb->b = realloc(sb->b, sb->cap);
+    }
+    memset(sb->b + sb->len, 0, off - sb->len);
+    if ( p != NULL ) memcpy(sb->b + off, p, n);
+    else memset(sb->b + off, 0, n);
+    sb->len = off + n;
+    return off;
+}
+#define snap_str(sb, s)    snap_put(sb, s, strlen(s)+1)
+/*----------------------------------------------------------------------------*/
+int save_namelist_snapshot(int file, const char *sname)
+{
+    NML *fl = nml_of(file);
+    SNAP_Buf sb = { NULL, 0, 0 };
+    SNAP_Header hdr;
+    SNAP_Source *src;
+    SNAP_Section *sec;
+    SNAP_Entry *ent;
+    NML_Value *v;
+    char name[1024];
+    FILE *f;
+    int i, j, k, n_src = 0, n_ent = 0;
+    uint64_t o_src, o_sec, o_ent;
+
+    if ( fl->base >= 0 ) {
+        fprintf(stderr, "An overlay of \"%s\" cannot be saved as a snapshot\n", fl->fname);
+        return -1;
+    }
+    if ( sname == NULL ) {
+        if ( !snapshot_name(fl->fname, name, sizeof(name)) ) return -1;
+        sname = name;
+    }
+
+    /* everything has to be read first */
     for (i = 0; i < fl->count; i++) {
+        find_section(fl, fl->index, hash_name(HASH_SEED, fl->section[i].name),
+                                                              fl->section[i].name);
+        n_ent += fl->section[i].count;
+    }
+    for (i = 0; i < fl->n_text; i++)
+        if ( fl->text[i].fname != NULL ) n_src++;
+
+    /* a namelist read from a snapshot has no text of its sources, only what  */
+    /* they were then; if one has changed since, what it holds is out of date */
+    for (i = 0; i < fl->n_text; i++) {
+        NML_Text *t = &fl->text[i];
+        char *text;
+        size_t len;
+        int same;
+
+        if ( t->fname == NULL || t->text != NULL ) continue;
+        if ( (text = load_file(t->fname, &len)) == NULL ) same = FALSE;
+        else {
+            same = ( hash_text(text, len) == t->hash );
+            unload_file(text);
+        }
+        if ( !same ) {
+            fprintf(stderr, "\"%s\" has changed since it was read, no snapshot saved\n", t->fname);
+            return -1;
+        }
+    }
+
+    snap_put(&sb, NULL, sizeof(SNAP_Header));
+    o_src = snap_put(&sb, NULL, n_src * sizeof(SNAP_Source));
+    o_sec = snap_put(&sb, NULL, fl->count * sizeof(SNAP_Section));
+    o_ent = snap_put(&sb, NULL, n_ent * sizeof(SNAP_Entry));
+
+    for (i = k = 0; i < fl->n_text; i++) {
+        NML_Text *t = &fl->text[i];
+        uint64_t nm;
+        if ( t->fname == NULL ) continue;
+        nm = snap_str(&sb, t->fname);
+        src = (SNAP_Source*)(sb.b + o_src) + k++;
+        src->mtime = t->mtime; src->fsize = t->fsize;
+        /* a source of the snapshot this was loaded from keeps its old hash */
+        src->hash = ( t->text != NULL ) ? hash_text(t->text, t->len) : t->hash;
+        src->name = nm;
+    }
+
+    for (i = k = 0; i < fl->count; i++) {
+        NML_Section *ns = &fl->section[i];
+        uint64_t nm = snap_str(&sb, ns->name);
+
+        sec = (SNAP_Section*)(sb.b + o_sec) + i;
+        sec->name = nm; sec->first = k; sec->count = ns->count;
+        sec->thash = ns->thash; sec->tlen = ns->tlen;
+
+        for (j = 0; j < ns->count; j++, k++) {
+            NML_Entry *ne = &ns->entry[j];
+            uint64_t en, dat, rp = 0;
+
+            en = snap_str(&sb, ne->name);
+            dat = snap_put(&sb, ne->data, ne->nval * sizeof(NML_Value));
+            if ( (ne->type & MASK_TYPE) == TYPE_STR ) {
+                int l;
+                for (l = 0; l < ne->nval; l++) {
+                    uint64_t so = ( ne->data[l].s != NULL ) ? snap_str(&sb, ne->data[l].s) : 0;
+                    v = (NML_Value*)(sb.b + dat) + l;
+                    memset(v, 0, sizeof(NML_Value));
+                    memcpy(v, &so, sizeof(so));
+                }
+            }
+            if ( ne->rep != NULL ) rp = snap_put(&sb, ne->rep, ne->nval * sizeof(int));
+
+            ent = (SNAP_Entry*)(sb.b + o_ent) + k;
+            ent->name = en; ent->data = dat; ent->rep = rp;
+            ent->type = ne->type; ent->count = ne->count; ent->nval = ne->nval;
+            ent->pad = 0;
+        }
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAP_MAGIC, 8);
+    hdr.version = SNAP_VERSION; hdr.endian = SNAP_ENDIAN;
+    hdr.value_size = sizeof(NML_Value);
+    hdr.n_src = n_src; hdr.n_sect = fl->count; hdr.n_entry = n_ent;
+    hdr.off_src = o_src; hdr.off_sect = o_sec; hdr.off_entry = o_ent;
+    hdr.size = sb.len;
+    hdr.check = hash_text(sb.b + sizeof(hdr), sb.len - sizeof(hdr));
+    memcpy(sb.b, &hdr, sizeof(hdr));
+
+    if ( (f = fopen(sname, "wb")) == NULL ) {
+        fprintf(stderr, "Could not write namelist snapshot \"%s\"\n", sname);
+        free(sb.b);
+        return -1;
+    }
+    k = ( fwrite(sb.b, 1, sb.len, f) == sb.len );
+    if ( fclose(f) != 0 ) k = FALSE;
+    free(sb.b);
+    if ( !k ) {
+        fprintf(stderr, "Could not write namelist snapshot \"%s\"\n", sname);
+        remove(sname);
+        return -1;
+    }
+    return 0;
+}
+/*----------------------------------------------------------------------------*/
+static int snapshot_current(const char *base, const SNAP_Header *hdr)
+{
+    const SNAP_Source *src = (const SNAP_Source*)(base + hdr->off_src);
+    struct stat st;
+    char *text;
+    size_t len;
+    int same;
+    uint32_t i;
+
+    for (i = 0; i < hdr->n_src; i++, src++) {
+        const char *nm = base + src->name;
+
+        if ( stat(nm, &st) != 0 || st.st_size != src->fsize ) return FALSE;
+        if ( stat_mtime(&st) == src->mtime ) continue;
+
+        /* touched, but it may still be the same */
+        if ( (text = load_file(nm, &len)) == NULL ) return FALSE;
+        same = ( hash_text(text, len) == src->hash );
+        unload_file(text);
+        if ( !same ) return FALSE;
+    }
+    return TRUE;
+}
+/*----------------------------------------------------------------------------*/
+/* A snapshot is only a cache, so anything in it that does not add up is      */
+/* cause to ignore it : every offset must land inside the file, suitably      */
+/* aligned, every name must end inside it and every count must agree.         */
+/*----------------------------------------------------------------------------*/
+static int snap_fits(size_t len, uint64_t off, uint64_t n, size_t size, size_t align)
+{
+    if ( off > len || (off & (align - 1)) != 0 ) return FALSE;
+    return n <= (len - off) / size;
+}
+/*----------------------------------------------------------------------------*/
+static int snap_name_ok(const char *base, size_t len, uint64_t off)
+{
+    return off < len && memchr(base + off, 0, len - off) != NULL;
+}
+/*----------------------------------------------------------------------------*/
+static int snapshot_valid(const char *base, size_t len, const SNAP_Header *hdr)
+{
+    const SNAP_Source *src;
+    const SNAP_Section *sec;
+    const SNAP_Entry *ent;
+    uint32_t i, l;
+
+    if ( !snap_fits(len, hdr->off_src, hdr->n_src, sizeof(SNAP_Source), 8) ||
+         !snap_fits(len, hdr->off_sect, hdr->n_sect, sizeof(SNAP_Section), 8) ||
+         !snap_fits(len, hdr->off_entry, hdr->n_entry, sizeof(SNAP_Entry), 8) )
+        return FALSE;
+
+    src = (const SNAP_Source*)(base + hdr->off_src);
+    for (i = 0; i < hdr->n_src; i++)
+        if ( !snap_name_ok(base, len, src[i].name) ) return FALSE;
+
+    sec = (const SNAP_Section*)(base + hdr->off_sect);
+    for (i = 0; i < hdr->n_sect; i++)
+        if ( !snap_name_ok(base, len, sec[i].name) ||
+             (uint64_t)sec[i].first + sec[i].count > hdr->n_entry ) return FALSE;
+
+    ent = (const SNAP_Entry*)(base + hdr->off_entry);
+    for (i = 0; i < hdr->n_entry; i++) {
+        const SNAP_Entry *se = &ent[i];
+        int64_t total = 0;
+
+        if ( !snap_name_ok(base, len, se->name) || se->nval < 0 || se->count < 0 ||
+             (se->type & MASK_TYPE) > TYPE_BOOL ||
+             !snap_fits(len, se->data, se->nval, sizeof(NML_Value), 8) ) return FALSE;
+
+        if ( se->rep != 0 ) {
+            const int *r;
+            if ( !snap_fits(len, se->rep, se->nval, sizeof(int), sizeof(int)) ) return FALSE;
+            r = (const int*)(base + se->rep);
+            for (l = 0; l < (uint32_t)se->nval; l++) {
+                if ( r[l] < 1 ) return FALSE;
+                total += r[l];
+            }
+        } else
+            total = se->nval;
+        if ( total != se->count ) return FALSE;
+
+        if ( (se->type & MASK_TYPE) == TYPE_STR ) {
+            const NML_Value *v = (const NML_Value*)(base + se->data);
+            for (l = 0; l < (uint32_t)se->nval; l++) {
+                uint64_t so;
+                memcpy(&so, &v[l], sizeof(so));
+                if ( so != 0 && !snap_name_ok(base, len, so) ) return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+/*----------------------------------------------------------------------------*/
+static int load_snapshot(NML *fl, const char *sname)
+{
+    const SNAP_Header *hdr;
+    const SNAP_Section *sec;
+    const SNAP_Entry *ent;
+    const SNAP_Source *src;
+    NML_Text *t;
+    char *base;
+    size_t len;
+    uint32_t i, j, l;
+
+    if ( (base = load_file(sname, &len)) == NULL ) return FALSE;
+    hdr = (const SNAP_Header*)base;
+    if ( len < sizeof(SNAP_Header) || memcmp(hdr->magic, SNAP_MAGIC, 8) != 0 ||
+         hdr->version != SNAP_VERSION || hdr->endian != SNAP_ENDIAN ||
+         hdr->value_size != sizeof(NML_Value) || hdr->size != len ||
+         hdr->check != hash_text(base + sizeof(SNAP_Header), len - sizeof(SNAP_Header)) ||
+         !snapshot_valid(base, len, hdr) || !snapshot_current(base, hdr) ) {
+        unload_file(base);
+        return FALSE;
+    }
+
+    /* keep it until the namelist is closed */
+    fl->text = nml_grow(fl, fl->text, fl->n_text, &fl->text_size, sizeof(NML_Text));
+    t = &fl->text[fl->n_text++];
+    t->text = base; t->len = len;
+    t->fname = NULL; t->mtime = t->fsize = -1;
+    t->hash = 0;
+    t->incl = NULL;
+
+    /* and its sources, with no text, to be watched */
+    src = (const SNAP_Source*)(base + hdr->off_src);
+    for (i = 0; i < hdr->n_src; i++, src++) {
+        fl->text = nml_grow(fl, fl->text, fl->n_text, &fl->text_size, sizeof(NML_Text));
+        t = &fl->text[fl->n_text++];
+        t->text = NULL; t->len = 0;
+        t->fname = base + src->name;
+        t->mtime = src->mtime; t->fsize = src->fsize;
+        t->hash = src->hash;
+        t->incl = NULL;
+    }
+
+    fl->count = fl->size = hdr->n_sect;
+    fl->section = nml_alloc(fl, (hdr->n_sect + 1) * sizeof(NML_Section));
+    sec = (const SNAP_Section*)(base + hdr->off_sect);
+    ent = (const SNAP_Entry*)(base + hdr->off_entry);
+
+    for (i = 0; i < hdr->n_sect; i++, sec++) {
         NML_Section *ns = &fl->section[i];
 
-        for (j = 0; j < ns->count; j++) {
+        memset(ns, 0, sizeof(NML_Section));
+        ns->name = base + sec->name;
+        ns->count = ns->size = sec->count;
+        ns->entry = nml_alloc(fl, (sec->count + 1) * sizeof(NML_Entry));
+        ns->parsed = TRUE;
+        ns->thash = sec->thash;
+        ns->tlen = sec->tlen;
+
+        for (j = 0; j < sec->count; j++) {
+            const SNAP_Entry *se = &ent[sec->first + j];
             NML_Entry *ne = &ns->entry[j];
-            if ( ne->data != NULL ) {
-                if ( ne->type == TYPE_STR ) {
-                    NML_Value *nv;
-                    for (k = 0; k < ne->count; k++) {
-                        nv = &ne->data[k];
-                        if (nv->s != NULL) free(nv->s);
-                    }
+
+            ne->name = base + se->name;
+            ne->type = se->type;
+            ne->count = se->count;
+            ne->nval = ne->size = se->nval;
+            ne->data = (NML_Value*)(base + se->data);
+            ne->rep = ( se->rep != 0 ) ? (int*)(base + se->rep) : NULL;
+            ne->view = NULL;
+            ne->reals = NULL;
+
+            if ( (ne->type & MASK_TYPE) == TYPE_STR ) {
+                NML_Value *v = nml_alloc(fl, (ne->nval + 1) * sizeof(NML_Value));
+                for (l = 0; l < (uint32_t)ne->nval; l++) {
+                    uint64_t so;
+                    memcpy(&so, &ne->data[l], sizeof(so));
+                    v[l].s = ( so != 0 ) ? base + so : NULL;
                 }
-                free(ne->data);
+                ne->data = v;
             }
-            free(ne->name);
         }
-        free(ns->entry);
-        free(ns->name);
     }
-    free(fl->section);
+    return TRUE;
+}
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+/******************************************************************************
+ *                                                                            *
+ ******************************************************************************/
+void close_namelist(int file)
+{
+    NML *fl;
+
+    nml_lock(&list_lock);
+    if ( file < 0 || file >= list_count ||
+         (fl = nml_of(file))->fname == NULL || fl->overlays < 0 ) {
+        nml_unlock(&list_lock);
+        return;
+    }
+    if ( fl->overlays > 0 ) {
+        nml_unlock(&list_lock);
+        fprintf(stderr, "\"%s\" still has %d overlay(s) open, not closed\n",
+                                                       fl->fname, fl->overlays);
+        return;
+    }
+    fl->overlays = -1;
+    if ( fl->base >= 0 ) nml_of(fl->base)->overlays--;
+    nml_unlock(&list_lock);
 
-    if (err) exit(1);
+    free_namelist(file);
 }
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/